@@ -1,44 +1,281 @@
 #include <algorithm>
+#include <iterator>
 #include <memory>
+#include <new>
+#include <sys/mman.h>
 #include "allocator.h"
 #include "smallfunctions.h"
 
 //------------------------------------------------------------------------------------
 
-RealAllocator::RealAllocator():
-	_current_full_size(0),
+ArenaConfig::ArenaConfig():
+	source(MALLOC_PAGES),
+	page_size(4096),
+	growth_factor(2),
+	max_page_size(64 * 1024 * 1024),
+	huge_pages(false),
+	prefault(false)
+{}
+
+//------------------------------------------------------------------------------------
+
+RealAllocator::RealAllocator(const ArenaConfig& config):
+	_config(config),
+	_next_page_size(config.page_size),
 	_current_free_size(0),
-	_current_ptr(nullptr)
+	_current_ptr(nullptr),
+	_pages(nullptr),
+	_spare_pages(nullptr),
+	_free_lists(),
+	_stats()
 {}
 
 RealAllocator::~RealAllocator() {
-	for (auto &_page : _pages) {
-		free(_page);
+	for (PageHeader* chain : {_pages, _spare_pages}) {
+		while (chain != nullptr) {
+			PageHeader* next = chain->next;
+			release_page(chain, chain->size);
+			chain = next;
+		}
 	}
 }
 
+// Huge pages are only used for 2 MiB aligned ranges, so the mapping is
+// taken bigger and trimmed down to an aligned middle.
+void* RealAllocator::acquire_page(size_t size) {
+	void* page;
+	if (_config.source == MALLOC_PAGES) {
+		page = malloc(size);
+		if (page == nullptr) {
+			throw std::bad_alloc();
+		}
+	}
+	else {
+		size_t align = _config.huge_pages ? _HUGE_PAGE_SIZE : 1;
+		size_t mapped_size = size + align - 1;
+		void* mapped = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+		                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (mapped == MAP_FAILED) {
+			throw std::bad_alloc();
+		}
+
+		page = mapped;
+		size_t space = mapped_size;
+		std::align(align, size, page, space);
+		size_t head = static_cast<char*>(page) - static_cast<char*>(mapped);
+		if (head > 0) {
+			munmap(mapped, head);
+		}
+		if (mapped_size - head > size) {
+			munmap(static_cast<char*>(page) + size, mapped_size - head - size);
+		}
+#ifdef MADV_HUGEPAGE
+		if (_config.huge_pages) {
+			madvise(page, size, MADV_HUGEPAGE);
+		}
+#endif
+	}
+
+	if (_config.prefault) {
+		for (size_t i = 0; i < size; i += 4096) {
+			static_cast<volatile char*>(page)[i] = 0;
+		}
+	}
+	return page;
+}
+
+void RealAllocator::release_page(void* page, size_t size) {
+	if (_config.source == MALLOC_PAGES) {
+		free(page);
+	}
+	else {
+		munmap(page, size);
+	}
+}
+
+// Pages grow geometrically, so the number of pages is logarithmic in the
+// arena size until max_page_size is reached. A request that doesn't fit
+// the next page gets a page of its own size and doesn't change the growth.
 void RealAllocator::new_page(size_t min_size) {
-	_current_full_size = std::max((size_t)1, div_ceil(min_size, _PAGE_SIZE))*_PAGE_SIZE;
-	_current_free_size = _current_full_size;
-	_current_ptr = malloc(_current_full_size);
-	_pages.push_back(_current_ptr);
+	_stats.page_tail_bytes += _current_free_size;
+
+	size_t step = _config.page_size;
+	if (_config.huge_pages) {
+		step = div_ceil(step, _HUGE_PAGE_SIZE) * _HUGE_PAGE_SIZE;
+	}
+	PageHeader* page = take_spare_page(min_size + sizeof(PageHeader));
+	if (page == nullptr) {
+		size_t page_size = div_ceil(std::max(_next_page_size, min_size + sizeof(PageHeader)), step)*step;
+		page = static_cast<PageHeader*>(acquire_page(page_size));
+		page->size = page_size;
+
+		size_t grown = (size_t)(_next_page_size * _config.growth_factor);
+		_next_page_size = std::min(std::max(grown, _next_page_size), _config.max_page_size);
+	}
+
+	page->next = _pages;
+	_pages = page;
+	_current_ptr = page + 1;
+	_current_free_size = page->size - sizeof(PageHeader);
+
+	_stats.pages++;
+	_stats.page_bytes += page->size;
+}
+
+// Spare pages are kept smallest first, so the first that fits is the
+// smallest that does.
+RealAllocator::PageHeader* RealAllocator::take_spare_page(size_t min_size) {
+	for (PageHeader** link = &_spare_pages; *link != nullptr; link = &(*link)->next) {
+		if ((*link)->size >= min_size) {
+			PageHeader* page = *link;
+			*link = page->next;
+			return page;
+		}
+	}
+	return nullptr;
+}
+
+void RealAllocator::add_spare_page(PageHeader* page) {
+	PageHeader** link = &_spare_pages;
+	while (*link != nullptr and (*link)->size < page->size) {
+		link = &(*link)->next;
+	}
+	page->next = *link;
+	*link = page;
 }
 
 void* RealAllocator::alloc_on_current_page(size_t size) {
 	void* result = _current_ptr;
 	_current_free_size -= size;
-	_current_ptr = increase_ptr(_current_ptr, (int)size);
+	_current_ptr = increase_ptr(_current_ptr, (ptrdiff_t)size);
 
 	return result;
 }
 
+size_t RealAllocator::block_size(size_t size) {
+	return std::max((size_t)1, div_ceil(size, _SIZE_CLASS_STEP))*_SIZE_CLASS_STEP;
+}
+
+RealAllocator::FreeBlock*& RealAllocator::free_list(size_t size) {
+	if (size <= _MAX_SMALL_SIZE) {
+		return _free_lists[size / _SIZE_CLASS_STEP];
+	}
+	return _big_free_lists[size];
+}
+
+void RealAllocator::add_live(size_t size) {
+	_stats.live_bytes += size;
+	_stats.peak_live_bytes = std::max(_stats.peak_live_bytes, _stats.live_bytes);
+}
+
 void* RealAllocator::allocate(size_t align, size_t size) {
-	std::align(align, size, _current_ptr, _current_free_size);
+	_stats.requested_bytes += size;
+	size = block_size(size);
+	add_live(size);
 
-	if (size > _current_free_size) {
-		new_page(size);
+	FreeBlock*& head = free_list(size);
+	if (head != nullptr and (size_t)head % align == 0) {
+		FreeBlock* result = head;
+		head = head->next;
+		_stats.dead_bytes -= size;
+		return result;
 	}
 
+	size_t free_size = _current_free_size;
+	if (std::align(align, size, _current_ptr, _current_free_size) == nullptr) {
+		new_page(size + align - 1);
+		free_size = _current_free_size;
+		std::align(align, size, _current_ptr, _current_free_size);
+	}
+	_stats.padding_bytes += free_size - _current_free_size;
+
 	return alloc_on_current_page(size);
 }
 
+void RealAllocator::deallocate(void* ptr, size_t size) {
+	if (ptr == nullptr) {
+		return;
+	}
+
+	size = block_size(size);
+	FreeBlock*& head = free_list(size);
+	auto block = static_cast<FreeBlock*>(ptr);
+	block->next = head;
+	head = block;
+
+	_stats.live_bytes -= size;
+	_stats.dead_bytes += size;
+}
+
+void RealAllocator::abandon(size_t size, size_t count) {
+	size = block_size(size) * count;
+	_stats.live_bytes -= size;
+	_stats.dead_bytes += size;
+}
+
+// Looks the list up without free_list(), which would add an empty one.
+size_t RealAllocator::free_blocks(size_t size, size_t limit) const {
+	size = block_size(size);
+	FreeBlock* head = nullptr;
+	if (size <= _MAX_SMALL_SIZE) {
+		head = _free_lists[size / _SIZE_CLASS_STEP];
+	}
+	else {
+		auto found = _big_free_lists.find(size);
+		if (found != _big_free_lists.end()) {
+			head = found->second;
+		}
+	}
+
+	size_t count = 0;
+	for (FreeBlock* block = head; block != nullptr and count < limit; block = block->next) {
+		++count;
+	}
+	return count;
+}
+
+AllocatorStats RealAllocator::stats() const {
+	return _stats;
+}
+
+void RealAllocator::clear_free_lists() {
+	std::fill(std::begin(_free_lists), std::end(_free_lists), nullptr);
+	_big_free_lists.clear();
+}
+
+//------------------------------------------------------------------------------------
+
+RealAllocator::Marker RealAllocator::mark() const {
+	return Marker{_pages, _current_ptr, _current_free_size, _stats};
+}
+
+// Pages newer than the marker move to the spare list.
+void RealAllocator::rewind(const Marker& marker) {
+	while (_pages != marker.page) {
+		PageHeader* page = _pages;
+		_pages = page->next;
+		add_spare_page(page);
+	}
+	_current_ptr = marker.ptr;
+	_current_free_size = marker.free_size;
+	clear_free_lists();
+
+	size_t peak_live_bytes = _stats.peak_live_bytes;
+	_stats = marker.stats;
+	_stats.peak_live_bytes = peak_live_bytes;
+}
+
+void RealAllocator::reset() {
+	rewind(Marker());
+}
+
+//------------------------------------------------------------------------------------
+
+ArenaScope::ArenaScope(RealAllocator& arena):
+	_arena(arena),
+	_marker(arena.mark())
+{}
+
+ArenaScope::~ArenaScope() {
+	_arena.rewind(_marker);
+}
@@ -1,37 +1,153 @@
 #pragma once
 #include <memory>
 #include <cstddef>
+#include <limits>
+#include <new>
+#include <unordered_map>
+#include <utility>
 #include "smallfunctions.h"
 #include "list.h"
 
+// All sizes in bytes. Live and dead bytes count whole blocks, which are
+// rounded up to the size class of the request. Page bytes include the
+// header at the start of every page.
+struct AllocatorStats {
+	size_t pages;
+	size_t page_bytes;
+	size_t requested_bytes;
+	size_t padding_bytes;
+	size_t page_tail_bytes;
+	size_t live_bytes;
+	size_t dead_bytes;
+	size_t peak_live_bytes;
+};
+
+enum PageSource {MALLOC_PAGES, MMAP_PAGES};
+
+// How RealAllocator gets its pages. The first page is page_size bytes and
+// every next one growth_factor times bigger, up to max_page_size. Huge pages
+// ask the kernel for transparent huge pages and round page sizes up to
+// 2 MiB; prefault touches every page as soon as it is taken.
+struct ArenaConfig {
+	PageSource source;
+	size_t page_size;
+	double growth_factor;
+	size_t max_page_size;
+	bool huge_pages;
+	bool prefault;
+
+	ArenaConfig();
+};
+
 class RealAllocator {
 public:
-	RealAllocator();
+	explicit RealAllocator(const ArenaConfig& config = ArenaConfig());
 	~RealAllocator();
 
+	RealAllocator(const RealAllocator&) = delete;
+	RealAllocator& operator=(const RealAllocator&) = delete;
+
 	void* allocate(size_t align, size_t size);
+	void deallocate(void* ptr, size_t size);
+	// count blocks of size bytes are no longer used but are not handed
+	// back; they count as dead until the arena is rewound.
+	void abandon(size_t size, size_t count);
+	// Freed blocks that allocate(size) would reuse, counted up to limit.
+	size_t free_blocks(size_t size, size_t limit) const;
+
+	AllocatorStats stats() const;
+
+	struct PageHeader;
+
+	// Position in the arena returned by mark().
+	struct Marker {
+		PageHeader* page;
+		void* ptr;
+		size_t free_size;
+		AllocatorStats stats;
+	};
+
+	// rewind() frees at once everything allocated after mark(), and reset()
+	// everything at all. Blocks freed before are forgotten too. Pages are
+	// kept for the next allocations instead of going back to the system.
+	// Markers taken after the one rewound to become invalid.
+	Marker mark() const;
+	void rewind(const Marker& marker);
+	void reset();
 private:
-	static constexpr size_t _PAGE_SIZE = 4096;
+	static constexpr size_t _HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+	static constexpr size_t _SIZE_CLASS_STEP = sizeof(void*);
+	static constexpr size_t _MAX_SMALL_SIZE = 256;
+
+	// Freed blocks are threaded through their own first word.
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+
+	static size_t block_size(size_t size);
+	FreeBlock*& free_list(size_t size);
 
+	void* acquire_page(size_t size);
+	void release_page(void* page, size_t size);
+	PageHeader* take_spare_page(size_t min_size);
+	void add_spare_page(PageHeader* page);
+	void clear_free_lists();
 	void new_page(size_t min_size);
 	void* alloc_on_current_page(size_t size);
+	void add_live(size_t size);
 
-	size_t _current_full_size;
+	ArenaConfig _config;
+	size_t _next_page_size;
 	size_t _current_free_size;
 	void* _current_ptr;
-	XorList<void*> _pages;
+	PageHeader* _pages;
+	PageHeader* _spare_pages;
+	FreeBlock* _free_lists[_MAX_SMALL_SIZE / _SIZE_CLASS_STEP + 1];
+	std::unordered_map<size_t, FreeBlock*> _big_free_lists;
+	AllocatorStats _stats;
 };
 
-template <typename T>
+// Starts every page, so pages are chained without extra allocations.
+struct RealAllocator::PageHeader {
+	PageHeader* next;
+	size_t size;
+};
+
+// Rewinds the arena to where it was when the scope was entered. Containers
+// using the arena must not outlive the scope, so declare it before them.
+class ArenaScope {
+public:
+	explicit ArenaScope(RealAllocator& arena);
+	~ArenaScope();
+
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+private:
+	RealAllocator& _arena;
+	RealAllocator::Marker _marker;
+};
+
+// Arena is RealAllocator by default; ConcurrentRealAllocator from
+// concurrent_allocator.h lets copies be used from several threads.
+template <typename T, class Arena = RealAllocator>
 class StackAllocator {
 public:
 	StackAllocator();
+	explicit StackAllocator(const ArenaConfig& config);
 	~StackAllocator() = default;
 	template <typename U>
-	explicit StackAllocator(const StackAllocator<U>&);
+	StackAllocator(const StackAllocator<U, Arena>&);
 
 	T* allocate(size_t size);
 	void deallocate(T* ptr, size_t size);
+	void abandon(size_t size);
+	size_t free_blocks(size_t limit) const;
+	// No other copy draws from the arena.
+	bool owns_arena() const;
+
+	AllocatorStats stats() const;
+	Arena& arena() const;
 
 	template <typename U>
 	void destroy(U* ptr);
@@ -40,7 +156,18 @@ public:
 	void construct(U* ptr, Args&&... args);
 
 	template<typename U>
-	struct rebind { typedef StackAllocator<U> other; };
+	struct rebind { typedef StackAllocator<U, Arena> other; };
+
+	// Copies and rebound copies draw from the same arena, so containers
+	// may take each other's allocator and hand nodes over without copying.
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	template <typename U>
+	bool operator==(const StackAllocator<U, Arena>&) const;
+	template <typename U>
+	bool operator!=(const StackAllocator<U, Arena>&) const;
 
 	typedef T value_type;
 	typedef T* pointer;
@@ -49,38 +176,93 @@ public:
 	typedef const T& const_reference;
 
 private:
-	std::shared_ptr<RealAllocator> _real_allocator;
+	template <typename U, class OtherArena>
+	friend class StackAllocator;
+
+	std::shared_ptr<Arena> _real_allocator;
 };
 
+// Not ConcurrentRealAllocator: its blocks are rounded to size classes, so a
+// bulk allocation can't be freed piece by piece.
+template <typename T>
+struct is_arena_allocator<StackAllocator<T, RealAllocator> > : std::true_type {};
+
 //******************************************************************
 
-template <typename T>
-StackAllocator<T>::StackAllocator() {
-    _real_allocator = std::make_shared<RealAllocator>();
+template <typename T, class Arena>
+StackAllocator<T, Arena>::StackAllocator() {
+    _real_allocator = std::make_shared<Arena>();
 }
 
-template <typename T>
+template <typename T, class Arena>
+StackAllocator<T, Arena>::StackAllocator(const ArenaConfig& config) {
+    _real_allocator = std::make_shared<Arena>(config);
+}
+
+template <typename T, class Arena>
 template <typename U>
-StackAllocator<T>::StackAllocator(const StackAllocator<U>&) {
-    _real_allocator = std::make_shared<RealAllocator>();
+StackAllocator<T, Arena>::StackAllocator(const StackAllocator<U, Arena>& other):
+    _real_allocator(other._real_allocator)
+{}
+
+template <typename T, class Arena>
+template <typename U>
+bool StackAllocator<T, Arena>::operator==(const StackAllocator<U, Arena>& other) const {
+    return _real_allocator == other._real_allocator;
 }
 
-template <typename T>
-T* StackAllocator<T>::allocate(size_t size) {
+template <typename T, class Arena>
+template <typename U>
+bool StackAllocator<T, Arena>::operator!=(const StackAllocator<U, Arena>& other) const {
+    return not (*this == other);
+}
+
+template <typename T, class Arena>
+T* StackAllocator<T, Arena>::allocate(size_t size) {
+    if (size > std::numeric_limits<size_t>::max() / sizeof(T)) {
+        throw std::bad_alloc();
+    }
     return static_cast<T*>(_real_allocator->allocate(alignof(T), size*sizeof(T)));
 }
 
-template <typename T>
-void StackAllocator<T>::deallocate(T* ptr, size_t size) {}
+template <typename T, class Arena>
+void StackAllocator<T, Arena>::deallocate(T* ptr, size_t size) {
+    _real_allocator->deallocate(ptr, size*sizeof(T));
+}
 
-template <typename T>
+template <typename T, class Arena>
+void StackAllocator<T, Arena>::abandon(size_t size) {
+    _real_allocator->abandon(sizeof(T), size);
+}
+
+template <typename T, class Arena>
+size_t StackAllocator<T, Arena>::free_blocks(size_t limit) const {
+    return _real_allocator->free_blocks(sizeof(T), limit);
+}
+
+template <typename T, class Arena>
+bool StackAllocator<T, Arena>::owns_arena() const {
+    return _real_allocator.use_count() == 1;
+}
+
+template <typename T, class Arena>
+AllocatorStats StackAllocator<T, Arena>::stats() const {
+    return _real_allocator->stats();
+}
+
+template <typename T, class Arena>
+Arena& StackAllocator<T, Arena>::arena() const {
+    return *_real_allocator;
+}
+
+template <typename T, class Arena>
 template <typename U>
-void StackAllocator<T>::destroy(U *ptr) {
+void StackAllocator<T, Arena>::destroy(U *ptr) {
 	ptr->~U();
 }
 
-template <typename T>
+template <typename T, class Arena>
 template<typename U, class... Args>
-void StackAllocator<T>::construct(U* ptr, Args&&... args ) {
+void StackAllocator<T, Arena>::construct(U* ptr, Args&&... args ) {
 	::new((void *)ptr) U(std::forward<Args>(args)...);
 };
@@ -0,0 +1,639 @@
+#include <benchmark/benchmark.h>
+#include <deque>
+#include <iterator>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include "allocator.h"
+#include "checker.h"
+#include "concurrent_allocator.h"
+#include "concurrent_list.h"
+#include "index_list.h"
+#include "list.h"
+#include "persistent_list.h"
+#include "test.h"
+
+// Run with --benchmark_out=<file> --benchmark_out_format=json to keep results.
+
+namespace bench {
+
+    template <size_t N>
+    struct Payload {
+        char data[N];
+
+        Payload(): data() {}
+        explicit Payload(int value): data() {
+            data[0] = (char)value;
+        }
+    };
+
+    typedef Payload<sizeof(Checker)> CheckerSized;
+    typedef Payload<64> Payload64;
+
+    template <typename T>
+    using StackXorList = XorList<T, StackAllocator<T> >;
+
+    // Mid-list operations differ between std containers and XorList; both
+    // versions return an iterator that stays usable for the next call.
+    template <class List>
+    struct ListOps {
+        typedef typename List::iterator iterator;
+        typedef typename List::value_type value_type;
+
+        static iterator insert_before(List& list, iterator pos, const value_type& value) {
+            auto it = list.insert(pos, value);
+            return ++it;
+        }
+
+        static iterator insert_after(List& list, iterator pos, const value_type& value) {
+            auto it = list.insert(std::next(pos), value);
+            return --it;
+        }
+
+        static iterator erase_after(List& list, iterator pos) {
+            auto it = list.erase(std::next(pos));
+            return --it;
+        }
+    };
+
+    // XorList and XorIndexList share insert_before/insert_after.
+    template <class List, typename T>
+    struct XorListOps {
+        typedef typename List::iterator iterator;
+        typedef T value_type;
+
+        static iterator insert_before(List& list, iterator pos, const T& value) {
+            return list.insert_before(pos, value);
+        }
+
+        static iterator insert_after(List& list, iterator pos, const T& value) {
+            return list.insert_after(pos, value);
+        }
+
+        static iterator erase_after(List& list, iterator pos) {
+            auto it = pos;
+            list.erase(++it);
+            return pos;
+        }
+    };
+
+    template <typename T, class Alloc>
+    struct ListOps<XorList<T, Alloc> > : XorListOps<XorList<T, Alloc>, T> {
+        typedef typename XorList<T, Alloc>::iterator iterator;
+
+        static iterator erase_after(XorList<T, Alloc>& list, iterator pos) {
+            auto it = list.erase(std::next(pos));
+            return --it;
+        }
+    };
+
+    template <typename T, class Alloc>
+    struct ListOps<XorIndexList<T, Alloc> > : XorListOps<XorIndexList<T, Alloc>, T> {};
+
+    template <class List>
+    void fill(List& list, size_t size) {
+        typedef typename ListOps<List>::value_type T;
+        for (size_t i = 0; i < size; ++i) {
+            list.push_back(T((int)i));
+        }
+    }
+
+    // RealAllocator behind one mutex, the way threads would have to share it.
+    struct LockedRealAllocator {
+        RealAllocator arena;
+        std::mutex mutex;
+
+        void* allocate(size_t align, size_t size) {
+            std::lock_guard<std::mutex> lock(mutex);
+            return arena.allocate(align, size);
+        }
+
+        void deallocate(void* ptr, size_t size) {
+            std::lock_guard<std::mutex> lock(mutex);
+            arena.deallocate(ptr, size);
+        }
+    };
+
+    template <class List>
+    typename List::iterator middle(List& list, size_t size) {
+        auto it = list.begin();
+        for (size_t i = 0; i < size / 2; ++i) {
+            ++it;
+        }
+        return it;
+    }
+
+}
+
+//-----------------------------------------------------------------------------
+
+template <class List>
+void BM_push_back(benchmark::State& state) {
+    typedef typename bench::ListOps<List>::value_type T;
+    auto size = (size_t)state.range(0);
+    for (auto _ : state) {
+        List list;
+        for (size_t i = 0; i < size; ++i) {
+            list.push_back(T((int)i));
+        }
+        benchmark::DoNotOptimize(&list.back());
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+template <class List>
+void BM_push_front(benchmark::State& state) {
+    typedef typename bench::ListOps<List>::value_type T;
+    auto size = (size_t)state.range(0);
+    for (auto _ : state) {
+        List list;
+        for (size_t i = 0; i < size; ++i) {
+            list.push_front(T((int)i));
+        }
+        benchmark::DoNotOptimize(&list.front());
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+template <class List>
+void BM_pop_front(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    for (auto _ : state) {
+        state.PauseTiming();
+        List list;
+        bench::fill(list, size);
+        state.ResumeTiming();
+        for (size_t i = 0; i < size; ++i) {
+            list.pop_front();
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+template <class List>
+void BM_pop_back(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    for (auto _ : state) {
+        state.PauseTiming();
+        List list;
+        bench::fill(list, size);
+        state.ResumeTiming();
+        for (size_t i = 0; i < size; ++i) {
+            list.pop_back();
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+template <class List>
+void BM_insert_before_mid(benchmark::State& state) {
+    typedef bench::ListOps<List> Ops;
+    auto size = (size_t)state.range(0);
+    List list;
+    bench::fill(list, size);
+    auto it = bench::middle(list, size);
+    for (auto _ : state) {
+        it = Ops::insert_before(list, it, typename Ops::value_type(1));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template <class List>
+void BM_insert_after_mid(benchmark::State& state) {
+    typedef bench::ListOps<List> Ops;
+    auto size = (size_t)state.range(0);
+    List list;
+    bench::fill(list, size);
+    auto it = bench::middle(list, size);
+    for (auto _ : state) {
+        it = Ops::insert_after(list, it, typename Ops::value_type(1));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Erases the back half of the list, one element after the middle at a time.
+template <class List>
+void BM_erase_mid(benchmark::State& state) {
+    typedef bench::ListOps<List> Ops;
+    auto size = (size_t)state.range(0);
+    for (auto _ : state) {
+        state.PauseTiming();
+        List list;
+        bench::fill(list, size);
+        auto it = bench::middle(list, size - 1);
+        state.ResumeTiming();
+        for (size_t i = 0; i < size / 2; ++i) {
+            it = Ops::erase_after(list, it);
+        }
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * (size / 2));
+}
+
+template <class List>
+void BM_traverse_forward(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    List list;
+    bench::fill(list, size);
+    for (auto _ : state) {
+        for (auto it = list.begin(); it != list.end(); ++it) {
+            benchmark::DoNotOptimize(*it);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+template <class List>
+void BM_traverse_backward(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    List list;
+    bench::fill(list, size);
+    for (auto _ : state) {
+        auto it = list.end();
+        for (size_t i = 0; i < size; ++i) {
+            --it;
+            benchmark::DoNotOptimize(*it);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+template <class List>
+void BM_clear(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    for (auto _ : state) {
+        state.PauseTiming();
+        List list;
+        bench::fill(list, size);
+        state.ResumeTiming();
+        list.clear();
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+void BM_abandon(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    for (auto _ : state) {
+        state.PauseTiming();
+        bench::StackXorList<int> list;
+        bench::fill(list, size);
+        state.ResumeTiming();
+        list.abandon();
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+template <class List>
+void BM_copy(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    List list;
+    bench::fill(list, size);
+    for (auto _ : state) {
+        List copy(list);
+        benchmark::DoNotOptimize(&copy.back());
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+template <class List>
+void BM_move(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    List list;
+    bench::fill(list, size);
+    for (auto _ : state) {
+        List moved(std::move(list));
+        list = std::move(moved);
+        benchmark::DoNotOptimize(&list);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// Nodes are relinked into random order by sort(), so every step of the walk
+// may land on another page. Run under perf stat -e dTLB-load-misses, or pass
+// --benchmark_perf_counters=dTLB-load-misses, to see the TLB side.
+void BM_traverse_arena(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    ArenaConfig config;
+    config.source = (PageSource)state.range(1);
+    config.huge_pages = state.range(2) != 0;
+    config.prefault = state.range(3) != 0;
+    if (config.source == MMAP_PAGES) {
+        config.page_size = 2 * 1024 * 1024;
+    }
+
+    StackAllocator<int> alloc(config);
+    XorList<int, StackAllocator<int> > list(alloc);
+    for (size_t i = 0; i < size; ++i) {
+        list.push_back(rand());
+    }
+    list.sort();
+
+    for (auto _ : state) {
+        long long sum = 0;
+        for (int value : list) {
+            sum += value;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+BENCHMARK(BM_traverse_arena)
+    ->ArgNames({"size", "mmap", "huge", "prefault"})
+    ->Args({1 << 20, MALLOC_PAGES, 0, 0})
+    ->Args({1 << 20, MMAP_PAGES, 0, 0})
+    ->Args({1 << 20, MMAP_PAGES, 1, 1})
+    ->Args({1 << 23, MALLOC_PAGES, 0, 0})
+    ->Args({1 << 23, MMAP_PAGES, 0, 0})
+    ->Args({1 << 23, MMAP_PAGES, 1, 1});
+
+// Summing a list far bigger than the caches, with nodes relinked into
+// random order by sort(). Mode 0 is the iterator loop, 1 the forward range,
+// 2 accumulate() with the prefetch distance of the last argument.
+void BM_traverse_prefetch(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    auto mode = state.range(1);
+    auto distance = (size_t)state.range(2);
+    XorList<int> list;
+    for (size_t i = 0; i < size; ++i) {
+        list.push_back(rand());
+    }
+    list.sort();
+
+    for (auto _ : state) {
+        long long sum = 0;
+        if (mode == 0) {
+            for (auto it = list.begin(); it != list.end(); ++it) {
+                sum += *it;
+            }
+        }
+        else if (mode == 1) {
+            for (int value : list.forward_range()) {
+                sum += value;
+            }
+        }
+        else {
+            sum = list.accumulate(0LL, std::plus<long long>(), distance);
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+BENCHMARK(BM_traverse_prefetch)
+    ->ArgNames({"size", "mode", "distance"})
+    ->Args({1 << 22, 0, 0})
+    ->Args({1 << 22, 1, 0})
+    ->Args({1 << 22, 2, 0})
+    ->Args({1 << 22, 2, 4})
+    ->Args({1 << 22, 2, 8})
+    ->Args({1 << 22, 2, 16});
+
+// Traversal after churn: rounds of erasing a quarter of the nodes and
+// inserting as many at other places, which hands the freed memory back in
+// reverse. Mode 0 walks a freshly built list, 1 the churned one, 2 the
+// churned one after compact() and 3 after a pass of compact_step(4096).
+template <class List>
+void BM_traverse_churn(benchmark::State& state) {
+    typedef bench::ListOps<List> Ops;
+    auto size = (size_t)state.range(0);
+    auto mode = state.range(1);
+    List list;
+    bench::fill(list, size);
+
+    if (mode != 0) {
+        srand(42);
+        for (int round = 0; round < 4; ++round) {
+            size_t erased = 0;
+            auto it = list.begin();
+            for (size_t i = 0; i + 1 < list.size(); ++i, ++it) {
+                if (rand() % 4 == 0) {
+                    it = Ops::erase_after(list, it);
+                    ++erased;
+                }
+            }
+            it = list.begin();
+            for (size_t i = 0; erased != 0; ++i, ++it) {
+                if (rand() % 4 == 0 or i + 1 == list.size()) {
+                    it = Ops::insert_after(list, it, rand());
+                    --erased;
+                }
+            }
+        }
+    }
+    if (mode == 2) {
+        list.compact();
+    }
+    if (mode == 3) {
+        while (not list.compact_step(4096)) {}
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(list.accumulate(0LL));
+    }
+    state.SetItemsProcessed(state.iterations() * list.size());
+}
+
+BENCHMARK_TEMPLATE(BM_traverse_churn, XorList<int>)
+    ->ArgNames({"size", "mode"})
+    ->ArgsProduct({{1 << 21}, {0, 1, 2, 3}});
+BENCHMARK_TEMPLATE(BM_traverse_churn, bench::StackXorList<int>)
+    ->ArgNames({"size", "mode"})
+    ->ArgsProduct({{1 << 21}, {0, 1, 2, 3}});
+
+// Eviction pass dropping every fourth element: remove_if() in place
+// against building a new list of the survivors, as callers had to before.
+template <class List>
+void BM_evict(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    auto in_place = state.range(1) != 0;
+    List list;
+    for (auto _ : state) {
+        state.PauseTiming();
+        list.clear();
+        bench::fill(list, size);
+        state.ResumeTiming();
+        if (in_place) {
+            list.remove_if([](int value) { return value % 4 == 0; });
+        }
+        else {
+            List survivors;
+            for (int value : list) {
+                if (value % 4 != 0) {
+                    survivors.push_back(value);
+                }
+            }
+            list = std::move(survivors);
+        }
+        benchmark::DoNotOptimize(list.size());
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+BENCHMARK_TEMPLATE(BM_evict, std::list<int>)
+    ->ArgNames({"size", "in_place"})->ArgsProduct({{1 << 20}, {0, 1}})->Iterations(20);
+BENCHMARK_TEMPLATE(BM_evict, XorList<int>)
+    ->ArgNames({"size", "in_place"})->ArgsProduct({{1 << 20}, {0, 1}})->Iterations(20);
+BENCHMARK_TEMPLATE(BM_evict, bench::StackXorList<int>)
+    ->ArgNames({"size", "in_place"})->ArgsProduct({{1 << 20}, {0, 1}})->Iterations(20);
+
+// Reads every element by index; with the finger cache each at() walks one
+// step, without it up to size / 2.
+void BM_at_sequential(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    XorList<int> list;
+    bench::fill(list, size);
+    list.set_finger_cache(state.range(1) != 0);
+    for (auto _ : state) {
+        for (size_t i = 0; i < size; ++i) {
+            benchmark::DoNotOptimize(list.at(i));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+BENCHMARK(BM_at_sequential)
+    ->ArgNames({"size", "finger"})
+    ->Args({1000, 0})->Args({10000, 0})
+    ->Args({1000, 1})->Args({10000, 1})->Args({100000, 1});
+
+// Every thread pushes to the back of one shared queue and pops from its
+// front. The queue starts long enough for the ends to be apart, so
+// ConcurrentXorList takes one lock per operation, the wrapped lists one
+// for the whole queue.
+template <class Deque>
+void BM_contention(benchmark::State& state) {
+    static Deque* deque;
+    if (state.thread_index() == 0) {
+        deque = new Deque();
+        for (int i = 0; i < 1024; ++i) {
+            deque->push_back(i);
+        }
+    }
+    int value = state.thread_index();
+    for (auto _ : state) {
+        deque->push_back(value);
+        benchmark::DoNotOptimize(deque->try_pop_front(value));
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+    if (state.thread_index() == 0) {
+        delete deque;
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_contention, ConcurrentXorList<int>)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_contention, MutexWrappedList<int, XorList<int> >)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_contention, MutexWrappedList<int, std::deque<int> >)->ThreadRange(1, 8)->UseRealTime();
+
+// Every thread takes a batch of node sized blocks from one shared arena and
+// frees them again, as lists of its own would while they churn. Blocks are
+// freed where they were taken, so ConcurrentRealAllocator serves them from
+// the thread's magazines.
+template <class Arena>
+void BM_arena_contention(benchmark::State& state) {
+    static Arena* arena;
+    if (state.thread_index() == 0) {
+        arena = new Arena();
+    }
+    const size_t size = sizeof(XorListNode<int>);
+    void* blocks[64];
+    for (auto _ : state) {
+        for (auto& block : blocks) {
+            block = arena->allocate(alignof(XorListNode<int>), size);
+        }
+        for (auto& block : blocks) {
+            arena->deallocate(block, size);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 64);
+    if (state.thread_index() == 0) {
+        delete arena;
+    }
+}
+
+BENCHMARK_TEMPLATE(BM_arena_contention, ConcurrentRealAllocator)->ThreadRange(1, 16)->UseRealTime();
+BENCHMARK_TEMPLATE(BM_arena_contention, bench::LockedRealAllocator)->ThreadRange(1, 16)->UseRealTime();
+
+// Startup cost of a list of ints: building it again from scratch against
+// opening the file a previous run left. Both read the ends to be fair.
+void BM_restart_rebuild(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    for (auto _ : state) {
+        XorList<int, StackAllocator<int> > list;
+        for (size_t i = 0; i < size; ++i) {
+            list.push_back((int)i);
+        }
+        benchmark::DoNotOptimize(list.front() + list.back());
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+}
+
+void BM_restart_reopen(benchmark::State& state) {
+    auto size = (size_t)state.range(0);
+    std::string path = "/tmp/xor_list_bench_" + std::to_string(getpid());
+    unlink(path.c_str());
+    {
+        PersistentXorList<int> list(path);
+        for (size_t i = 0; i < size; ++i) {
+            list.push_back((int)i);
+        }
+    }
+
+    for (auto _ : state) {
+        PersistentXorList<int> list(path);
+        benchmark::DoNotOptimize(list.front() + list.back());
+    }
+    state.SetItemsProcessed(state.iterations() * size);
+    unlink(path.c_str());
+}
+
+BENCHMARK(BM_restart_rebuild)->RangeMultiplier(10)->Range(1000, 10000000);
+BENCHMARK(BM_restart_reopen)->RangeMultiplier(10)->Range(1000, 10000000);
+
+//-----------------------------------------------------------------------------
+
+#define XOR_LIST_BENCHMARK_SIZES(benchmark) \
+    benchmark->RangeMultiplier(10)->Range(10, 10000000)
+
+#define XOR_LIST_BENCHMARK_CONTAINERS(func, T) \
+    XOR_LIST_BENCHMARK_SIZES(BENCHMARK_TEMPLATE(func, std::list<T>)); \
+    XOR_LIST_BENCHMARK_SIZES(BENCHMARK_TEMPLATE(func, std::deque<T>)); \
+    XOR_LIST_BENCHMARK_SIZES(BENCHMARK_TEMPLATE(func, XorList<T>)); \
+    XOR_LIST_BENCHMARK_SIZES(BENCHMARK_TEMPLATE(func, bench::StackXorList<T>)); \
+    XOR_LIST_BENCHMARK_SIZES(BENCHMARK_TEMPLATE(func, XorIndexList<T>))
+
+#define XOR_LIST_BENCHMARK(func) \
+    XOR_LIST_BENCHMARK_CONTAINERS(func, int); \
+    XOR_LIST_BENCHMARK_CONTAINERS(func, bench::CheckerSized); \
+    XOR_LIST_BENCHMARK_CONTAINERS(func, bench::Payload64)
+
+XOR_LIST_BENCHMARK(BM_push_back);
+XOR_LIST_BENCHMARK(BM_push_front);
+XOR_LIST_BENCHMARK(BM_pop_front);
+XOR_LIST_BENCHMARK(BM_pop_back);
+XOR_LIST_BENCHMARK(BM_insert_before_mid);
+XOR_LIST_BENCHMARK(BM_insert_after_mid);
+XOR_LIST_BENCHMARK(BM_erase_mid);
+XOR_LIST_BENCHMARK(BM_traverse_forward);
+XOR_LIST_BENCHMARK(BM_traverse_backward);
+XOR_LIST_BENCHMARK(BM_copy);
+XOR_LIST_BENCHMARK(BM_move);
+
+// Clearing is fast next to the paused refills, so the iteration count is
+// fixed to keep them from running forever.
+#define XOR_LIST_CLEAR_BENCHMARK(List) \
+    XOR_LIST_BENCHMARK_SIZES(BENCHMARK_TEMPLATE(BM_clear, List))->Iterations(20)
+
+XOR_LIST_CLEAR_BENCHMARK(std::list<int>);
+XOR_LIST_CLEAR_BENCHMARK(std::deque<int>);
+XOR_LIST_CLEAR_BENCHMARK(XorList<int>);
+XOR_LIST_CLEAR_BENCHMARK(bench::StackXorList<int>);
+XOR_LIST_CLEAR_BENCHMARK(bench::StackXorList<bench::Payload64>);
+XOR_LIST_BENCHMARK_SIZES(BENCHMARK(BM_abandon))->Iterations(20);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,274 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <unordered_map>
+#include "concurrent_allocator.h"
+#include "smallfunctions.h"
+
+std::atomic<size_t> ConcurrentRealAllocator::_next_id(1);
+
+namespace {
+
+    // Arenas alive by id, for threads that exit after an arena they used
+    // has been destroyed.
+    struct ArenaRegistry {
+        std::mutex mutex;
+        std::unordered_map<size_t, ConcurrentRealAllocator*> arenas;
+    };
+
+    ArenaRegistry& registry() {
+        static ArenaRegistry registry;
+        return registry;
+    }
+
+}
+
+struct ConcurrentRealAllocator::LocalCaches {
+    size_t last_id;
+    ThreadCache* last_cache;
+    std::unordered_map<size_t, ThreadCache*> caches;
+
+    LocalCaches();
+    ~LocalCaches();
+    void forget_destroyed();
+};
+
+//------------------------------------------------------------------------------------
+
+ConcurrentRealAllocator::ThreadCache::ThreadCache():
+    current_ptr(nullptr),
+    current_free_size(0),
+    magazines(),
+    magazine_sizes(),
+    in_use(true)
+{}
+
+ConcurrentRealAllocator::LocalCaches::LocalCaches():
+    last_id(0),
+    last_cache(nullptr)
+{}
+
+// Holding the registry keeps the arenas from being destroyed meanwhile.
+ConcurrentRealAllocator::LocalCaches::~LocalCaches() {
+    ArenaRegistry& live = registry();
+    std::lock_guard<std::mutex> lock(live.mutex);
+    for (auto& entry : caches) {
+        auto arena = live.arenas.find(entry.first);
+        if (arena != live.arenas.end()) {
+            arena->second->release_cache(*entry.second);
+        }
+    }
+}
+
+void ConcurrentRealAllocator::LocalCaches::forget_destroyed() {
+    ArenaRegistry& live = registry();
+    std::lock_guard<std::mutex> lock(live.mutex);
+    for (auto it = caches.begin(); it != caches.end();) {
+        if (live.arenas.count(it->first) == 0) {
+            it = caches.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+ConcurrentRealAllocator::ConcurrentRealAllocator():
+    _id(_next_id++)
+{
+    for (auto& head : _central) {
+        head.store(nullptr, std::memory_order_relaxed);
+    }
+
+    ArenaRegistry& live = registry();
+    std::lock_guard<std::mutex> lock(live.mutex);
+    live.arenas.emplace(_id, this);
+}
+
+ConcurrentRealAllocator::~ConcurrentRealAllocator() {
+    {
+        ArenaRegistry& live = registry();
+        std::lock_guard<std::mutex> lock(live.mutex);
+        live.arenas.erase(_id);
+    }
+    for (auto page : _pages) {
+        free(page);
+    }
+}
+
+// Threads find their cache by arena id, which is never reused, so a stale
+// entry left by a destroyed arena can't be picked up by a new one. Stale
+// entries are dropped whenever the thread meets a new arena.
+ConcurrentRealAllocator::ThreadCache& ConcurrentRealAllocator::local_cache() {
+    static thread_local LocalCaches local;
+
+    if (local.last_id != _id) {
+        auto it = local.caches.find(_id);
+        if (it == local.caches.end()) {
+            local.forget_destroyed();
+            it = local.caches.emplace(_id, acquire_cache()).first;
+        }
+        local.last_id = _id;
+        local.last_cache = it->second;
+    }
+    return *local.last_cache;
+}
+
+// Prefers the cache of a thread that has exited.
+ConcurrentRealAllocator::ThreadCache* ConcurrentRealAllocator::acquire_cache() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& cache : _caches) {
+        if (not cache->in_use) {
+            cache->in_use = true;
+            return cache.get();
+        }
+    }
+    _caches.emplace_back(new ThreadCache());
+    return _caches.back().get();
+}
+
+void ConcurrentRealAllocator::release_cache(ThreadCache& cache) {
+    for (size_t size_class = 0; size_class < _SIZE_CLASSES; ++size_class) {
+        FreeBlock* first = cache.magazines[size_class];
+        if (first == nullptr) {
+            continue;
+        }
+        FreeBlock* last = first;
+        while (last->next != nullptr) {
+            last = last->next;
+        }
+        push_central(size_class, first, last);
+        cache.magazines[size_class] = nullptr;
+        cache.magazine_sizes[size_class] = 0;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    cache.in_use = false;
+}
+
+void* ConcurrentRealAllocator::new_page(size_t size) {
+    void* page = malloc(size);
+    if (page == nullptr) {
+        throw std::bad_alloc();
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pages.push_back(page);
+    return page;
+}
+
+void* ConcurrentRealAllocator::allocate_big(size_t align, size_t size) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto range = _big_blocks.equal_range(size);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (reinterpret_cast<uintptr_t>(it->second) % align == 0) {
+                void* result = it->second;
+                _big_blocks.erase(it);
+                return result;
+            }
+        }
+    }
+
+    size_t space = size + align;
+    void* result = new_page(space);
+    return std::align(align, size, result, space);
+}
+
+void ConcurrentRealAllocator::deallocate_big(void* ptr, size_t size) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _big_blocks.emplace(size, ptr);
+}
+
+//------------------------------------------------------------------------------------
+
+void* ConcurrentRealAllocator::allocate(size_t align, size_t size) {
+    if (size > _MAX_SMALL_SIZE) {
+        return allocate_big(align, size);
+    }
+
+    size_t size_class = std::max((size_t)1, div_ceil(size, _SIZE_CLASS_STEP));
+    size = size_class * _SIZE_CLASS_STEP;
+    // deallocate() can't tell such a block from others of its size class.
+    if (align > _SIZE_CLASS_STEP) {
+        return allocate_big(align, size);
+    }
+    ThreadCache& cache = local_cache();
+
+    FreeBlock*& magazine = cache.magazines[size_class];
+    if (magazine == nullptr) {
+        magazine = _central[size_class].exchange(nullptr, std::memory_order_acquire);
+        size_t count = 0;
+        for (FreeBlock* block = magazine; block != nullptr; block = block->next) {
+            ++count;
+        }
+        cache.magazine_sizes[size_class] = count;
+    }
+
+    if (magazine != nullptr) {
+        FreeBlock* result = magazine;
+        magazine = magazine->next;
+        cache.magazine_sizes[size_class]--;
+        return result;
+    }
+
+    if (cache.current_free_size < size) {
+        cache.current_ptr = new_page(_PAGE_SIZE);
+        cache.current_free_size = _PAGE_SIZE;
+    }
+
+    void* result = cache.current_ptr;
+    cache.current_ptr = increase_ptr(cache.current_ptr, (ptrdiff_t)size);
+    cache.current_free_size -= size;
+    return result;
+}
+
+void ConcurrentRealAllocator::deallocate(void* ptr, size_t size) {
+    if (ptr == nullptr) {
+        return;
+    }
+    if (size > _MAX_SMALL_SIZE) {
+        deallocate_big(ptr, size);
+        return;
+    }
+
+    size_t size_class = std::max((size_t)1, div_ceil(size, _SIZE_CLASS_STEP));
+    ThreadCache& cache = local_cache();
+
+    auto block = static_cast<FreeBlock*>(ptr);
+    block->next = cache.magazines[size_class];
+    cache.magazines[size_class] = block;
+
+    if (++cache.magazine_sizes[size_class] >= 2 * _MAGAZINE_SIZE) {
+        flush_magazine(cache, size_class);
+    }
+}
+
+// Abandoned blocks stay on their pages until the arena is destroyed.
+void ConcurrentRealAllocator::abandon(size_t, size_t) {}
+
+// Keeps _MAGAZINE_SIZE blocks and hands the rest to the central pool.
+void ConcurrentRealAllocator::flush_magazine(ThreadCache& cache, size_t size_class) {
+    FreeBlock* cut = cache.magazines[size_class];
+    for (size_t i = 1; i < _MAGAZINE_SIZE; ++i) {
+        cut = cut->next;
+    }
+
+    FreeBlock* first = cut->next;
+    FreeBlock* last = first;
+    while (last->next != nullptr) {
+        last = last->next;
+    }
+    cut->next = nullptr;
+    cache.magazine_sizes[size_class] = _MAGAZINE_SIZE;
+    push_central(size_class, first, last);
+}
+
+void ConcurrentRealAllocator::push_central(size_t size_class, FreeBlock* first, FreeBlock* last) {
+    FreeBlock* head = _central[size_class].load(std::memory_order_relaxed);
+    do {
+        last->next = head;
+    } while (not _central[size_class].compare_exchange_weak(head, first,
+                                                            std::memory_order_release,
+                                                            std::memory_order_relaxed));
+}
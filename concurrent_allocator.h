@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "allocator.h"
+
+// Arena for StackAllocator that may be shared between threads. Every thread
+// bump-allocates from its own page and keeps freed blocks in a per-thread
+// magazine; overflowing magazines go to a lock-free central pool that any
+// thread can take whole. Only page acquisition takes the mutex.
+//
+// When a thread exits, its magazines go to the central pool and its cache,
+// with the rest of its page, to the next thread that uses the arena. Blocks
+// bigger than the largest size class are kept under the mutex and reused
+// for requests of the same size.
+class ConcurrentRealAllocator {
+public:
+    ConcurrentRealAllocator();
+    ~ConcurrentRealAllocator();
+
+    ConcurrentRealAllocator(const ConcurrentRealAllocator&) = delete;
+    ConcurrentRealAllocator& operator=(const ConcurrentRealAllocator&) = delete;
+
+    void* allocate(size_t align, size_t size);
+    void deallocate(void* ptr, size_t size);
+    void abandon(size_t size, size_t count);
+private:
+    static constexpr size_t _PAGE_SIZE = 65536;
+    static constexpr size_t _SIZE_CLASS_STEP = 16;
+    static constexpr size_t _MAX_SMALL_SIZE = 256;
+    static constexpr size_t _SIZE_CLASSES = _MAX_SMALL_SIZE / _SIZE_CLASS_STEP + 1;
+    static constexpr size_t _MAGAZINE_SIZE = 64;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct ThreadCache {
+        void* current_ptr;
+        size_t current_free_size;
+        FreeBlock* magazines[_SIZE_CLASSES];
+        size_t magazine_sizes[_SIZE_CLASSES];
+        bool in_use;
+
+        ThreadCache();
+    };
+
+    // The caches of one thread in every arena it has used.
+    struct LocalCaches;
+
+    ThreadCache& local_cache();
+    ThreadCache* acquire_cache();
+    void release_cache(ThreadCache& cache);
+    void* new_page(size_t size);
+    void* allocate_big(size_t align, size_t size);
+    void deallocate_big(void* ptr, size_t size);
+    void flush_magazine(ThreadCache& cache, size_t size_class);
+    void push_central(size_t size_class, FreeBlock* first, FreeBlock* last);
+
+    static std::atomic<size_t> _next_id;
+
+    const size_t _id;
+    std::mutex _mutex;
+    std::vector<void*> _pages;
+    std::vector<std::unique_ptr<ThreadCache> > _caches;
+    std::multimap<size_t, void*> _big_blocks;
+    std::atomic<FreeBlock*> _central[_SIZE_CLASSES];
+};
+
+template <typename T>
+using ConcurrentStackAllocator = StackAllocator<T, ConcurrentRealAllocator>;
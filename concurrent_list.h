@@ -0,0 +1,216 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include "list.h"
+#include "smallfunctions.h"
+
+// Double-ended queue on XorList nodes that may be used from several threads.
+// Each end has its own mutex; an operation takes only the lock of its end
+// while the list is long enough for the two ends to touch different nodes,
+// and both locks otherwise. Alloc must be safe to call from several threads,
+// e.g. std::allocator or ConcurrentStackAllocator.
+template <typename T, class Alloc = std::allocator<T> >
+class ConcurrentXorList {
+public:
+    explicit ConcurrentXorList(const Alloc& alloc = Alloc());
+    ~ConcurrentXorList();
+
+    ConcurrentXorList(const ConcurrentXorList<T, Alloc>&) = delete;
+    ConcurrentXorList<T, Alloc>& operator=(const ConcurrentXorList<T, Alloc>&) = delete;
+
+    size_t size() const;
+    bool empty() const;
+
+    template <typename U> void push_back(U&&);
+    template <typename U> void push_front(U&&);
+
+    // Return false instead of waiting when the list is empty.
+    bool try_pop_front(T& result);
+    bool try_pop_back(T& result);
+
+private:
+    typedef XorListNode<T> node;
+    typedef typename Alloc::template rebind<node>::other AllocNode;
+    typedef std::unique_lock<std::mutex> lock_type;
+
+    // Pop from one end rewrites the link of its neighbour, so with fewer
+    // nodes than this the ends may share a node.
+    static constexpr size_t _SEPARATE_ENDS_SIZE = 4;
+
+    void lock_end(bool front, lock_type& front_lock, lock_type& back_lock);
+    template <typename U> node* new_node(U&&);
+    void free_node(node*);
+
+    AllocNode _alloc;
+    std::mutex _front_mutex;
+    std::mutex _back_mutex;
+    node* _first;
+    node* _last;
+    std::atomic<size_t> _size;
+};
+
+//=======================================================================================
+//=======================================================================================
+
+template <typename T, class Alloc>
+ConcurrentXorList<T, Alloc>::ConcurrentXorList(const Alloc& alloc):
+        _alloc(alloc),
+        _first(nullptr), _last(nullptr),
+        _size(0)
+{}
+
+template <typename T, class Alloc>
+ConcurrentXorList<T, Alloc>::~ConcurrentXorList() {
+    node* first = nullptr;
+    node* second = _first;
+
+    while (second != nullptr) {
+        node* next_node = get_next(first, second);
+        first = second;
+        second = next_node;
+        free_node(first);
+    }
+}
+
+template <typename T, class Alloc>
+size_t ConcurrentXorList<T, Alloc>::size() const {
+    return _size.load();
+}
+
+template <typename T, class Alloc>
+bool ConcurrentXorList<T, Alloc>::empty() const {
+    return _size.load() == 0;
+}
+
+//----------------------------------------------------------------------
+
+// Size is read under the lock of our end: the other end can shrink the list
+// by at most the operation it is running now, which it hasn't counted yet.
+template <typename T, class Alloc>
+void ConcurrentXorList<T, Alloc>::lock_end(bool front, lock_type& front_lock,
+                                           lock_type& back_lock) {
+    lock_type& own_lock = front ? front_lock : back_lock;
+    own_lock.lock();
+    if (_size.load() >= _SEPARATE_ENDS_SIZE) {
+        return;
+    }
+
+    own_lock.unlock();
+    front_lock.lock();
+    back_lock.lock();
+}
+
+template <typename T, class Alloc>
+template <typename U>
+typename ConcurrentXorList<T, Alloc>::node* ConcurrentXorList<T, Alloc>::new_node(U&& value) {
+    node* result = _alloc.allocate(1);
+    _alloc.construct(result, std::forward<U>(value));
+    return result;
+}
+
+template <typename T, class Alloc>
+void ConcurrentXorList<T, Alloc>::free_node(node* old_node) {
+    _alloc.destroy(old_node);
+    _alloc.deallocate(old_node, 1);
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, class Alloc>
+template <typename U>
+void ConcurrentXorList<T, Alloc>::push_back(U&& value) {
+    node* added = new_node(std::forward<U>(value));
+
+    lock_type front_lock(_front_mutex, std::defer_lock);
+    lock_type back_lock(_back_mutex, std::defer_lock);
+    lock_end(false, front_lock, back_lock);
+
+    added->ptr = _last;
+    if (_last != nullptr) {
+        _last->ptr = xor_ptr(_last->ptr, added);
+    }
+    else {
+        _first = added;
+    }
+    _last = added;
+    _size.fetch_add(1);
+}
+
+template <typename T, class Alloc>
+template <typename U>
+void ConcurrentXorList<T, Alloc>::push_front(U&& value) {
+    node* added = new_node(std::forward<U>(value));
+
+    lock_type front_lock(_front_mutex, std::defer_lock);
+    lock_type back_lock(_back_mutex, std::defer_lock);
+    lock_end(true, front_lock, back_lock);
+
+    added->ptr = _first;
+    if (_first != nullptr) {
+        _first->ptr = xor_ptr(_first->ptr, added);
+    }
+    else {
+        _last = added;
+    }
+    _first = added;
+    _size.fetch_add(1);
+}
+
+template <typename T, class Alloc>
+bool ConcurrentXorList<T, Alloc>::try_pop_front(T& result) {
+    lock_type front_lock(_front_mutex, std::defer_lock);
+    lock_type back_lock(_back_mutex, std::defer_lock);
+    lock_end(true, front_lock, back_lock);
+
+    node* removed = _first;
+    if (removed == nullptr) {
+        return false;
+    }
+
+    node* next_node = removed->ptr;
+    if (next_node != nullptr) {
+        next_node->ptr = xor_ptr(next_node->ptr, removed);
+    }
+    else {
+        _last = nullptr;
+    }
+    _first = next_node;
+    _size.fetch_sub(1);
+
+    if (front_lock) front_lock.unlock();
+    if (back_lock) back_lock.unlock();
+
+    result = std::move(removed->value);
+    free_node(removed);
+    return true;
+}
+
+template <typename T, class Alloc>
+bool ConcurrentXorList<T, Alloc>::try_pop_back(T& result) {
+    lock_type front_lock(_front_mutex, std::defer_lock);
+    lock_type back_lock(_back_mutex, std::defer_lock);
+    lock_end(false, front_lock, back_lock);
+
+    node* removed = _last;
+    if (removed == nullptr) {
+        return false;
+    }
+
+    node* prev_node = removed->ptr;
+    if (prev_node != nullptr) {
+        prev_node->ptr = xor_ptr(prev_node->ptr, removed);
+    }
+    else {
+        _first = nullptr;
+    }
+    _last = prev_node;
+    _size.fetch_sub(1);
+
+    if (front_lock) front_lock.unlock();
+    if (back_lock) back_lock.unlock();
+
+    result = std::move(removed->value);
+    free_node(removed);
+    return true;
+}
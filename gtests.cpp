@@ -1,10 +1,25 @@
 #include <gtest/gtest.h>
+#include <array>
 #include <vector>
 #include <list>
+#include <deque>
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <functional>
 #include "allocator.h"
 #include "checker.h"
+#include "concurrent_allocator.h"
+#include "concurrent_list.h"
+#include "index_list.h"
+#include "intrusive_list.h"
 #include "list.h"
+#include "persistent_list.h"
 #include "test.h"
+#include "trace.h"
+#include "unrolled_list.h"
+#include "workload.h"
 
 using std::vector;
 
@@ -75,6 +90,338 @@ TEST(allocator, rebind) {
     EXPECT_EQ(*y, 0.0);
 }
 
+TEST(allocator, reuse) {
+    StackAllocator<double> alloc;
+
+    double* x = alloc.allocate(2);
+    alloc.deallocate(x, 2);
+    double* y = alloc.allocate(1);
+    double* z = alloc.allocate(2);
+
+    EXPECT_NE(x, y);
+    EXPECT_EQ(x, z);
+}
+
+TEST(allocator, queue_churn) {
+    XorList<int, StackAllocator<int> > list;
+    for (int i = 0; i < 16; ++i) {
+        list.push_back(i);
+    }
+    int* first = &list.front();
+    for (int i = 0; i < 100000; ++i) {
+        list.push_back(i);
+        list.pop_front();
+    }
+    list.push_back(0);
+    list.pop_front();
+
+    EXPECT_EQ(list.size(), 16);
+    bool recycled = false;
+    for (int& value : list) {
+        recycled = recycled or &value == first;
+    }
+    EXPECT_TRUE(recycled);
+}
+
+TEST(allocator, shared_arena) {
+    StackAllocator<double> alloc;
+    StackAllocator<double>::rebind<long long>::other rebound(alloc);
+
+    EXPECT_TRUE(alloc == rebound);
+    EXPECT_TRUE(alloc != StackAllocator<double>());
+
+    double* x = alloc.allocate(1);
+    alloc.deallocate(x, 1);
+    auto y = rebound.allocate(1);
+    EXPECT_EQ((void*)x, (void*)y);
+}
+
+TEST(allocator, concurrent_threads) {
+    ConcurrentStackAllocator<long long> alloc;
+    std::vector<std::thread> threads;
+    std::vector<int> ok(4, 0);
+
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([alloc, t, &ok]() mutable {
+            std::vector<long long*> blocks;
+            for (int i = 0; i < 10000; ++i) {
+                long long* x = alloc.allocate(1 + i % 3);
+                *x = t * 100000 + i;
+                blocks.push_back(x);
+                if (i % 2) {
+                    alloc.deallocate(blocks[i / 2], 1 + (i / 2) % 3);
+                    blocks[i / 2] = nullptr;
+                }
+            }
+            bool result = true;
+            for (int i = 0; i < (int)blocks.size(); ++i) {
+                result = result and (blocks[i] == nullptr or *blocks[i] == t * 100000 + i);
+            }
+            ok[t] = result ? 1 : 0;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(ok, std::vector<int>(4, 1));
+}
+
+TEST(allocator, concurrent_cross_thread_free) {
+    ConcurrentStackAllocator<int> alloc;
+    std::vector<int*> blocks;
+    for (int i = 0; i < 1000; ++i) {
+        blocks.push_back(alloc.allocate(1));
+    }
+
+    std::thread([alloc, &blocks]() mutable {
+        for (auto block : blocks) {
+            alloc.deallocate(block, 1);
+        }
+    }).join();
+
+    XorList<int, ConcurrentStackAllocator<int> > list(alloc);
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+    }
+    EXPECT_EQ(list.back(), 999);
+}
+
+TEST(allocator, concurrent_list_nodes) {
+    typedef std::pair<long long, long long> Value;
+    ConcurrentStackAllocator<Value> alloc;
+    XorList<Value, ConcurrentStackAllocator<Value> > list(alloc);
+    vector<Value> values(8, Value(1, 2));
+    list.assign(values.begin(), values.end());
+    list.pop_front();
+
+    ConcurrentStackAllocator<char> bytes(alloc);
+    char* block = bytes.allocate(32);
+    std::fill(block, block + 32, 0);
+
+    EXPECT_EQ(std::count(list.begin(), list.end(), Value(1, 2)), 7);
+}
+
+TEST(allocator, concurrent_thread_exit) {
+    ConcurrentStackAllocator<int> alloc;
+    int* block = nullptr;
+    std::thread([alloc, &block]() mutable {
+        block = alloc.allocate(1);
+        alloc.deallocate(block, 1);
+    }).join();
+
+    EXPECT_EQ(alloc.allocate(1), block);
+}
+
+TEST(allocator, concurrent_big_blocks) {
+    ConcurrentStackAllocator<int> alloc;
+    int* x = alloc.allocate(1000);
+    alloc.deallocate(x, 1000);
+    EXPECT_EQ(alloc.allocate(1000), x);
+    EXPECT_NE(alloc.allocate(1000), x);
+}
+
+TEST(allocator, size_overflow) {
+    StackAllocator<long long> alloc;
+    EXPECT_THROW(alloc.allocate(std::numeric_limits<size_t>::max() / 4), std::bad_alloc);
+}
+
+TEST(allocator, stats) {
+    StackAllocator<char> alloc;
+    char* x = alloc.allocate(3);
+    alloc.allocate(5000);
+    alloc.deallocate(x, 3);
+
+    AllocatorStats stats = alloc.stats();
+    EXPECT_EQ(stats.pages, 2);
+    EXPECT_EQ(stats.requested_bytes, 5003);
+    EXPECT_EQ(stats.live_bytes, 5000);
+    EXPECT_EQ(stats.dead_bytes, sizeof(void*));
+    EXPECT_EQ(stats.peak_live_bytes, 5000 + sizeof(void*));
+    EXPECT_EQ(stats.page_tail_bytes, 4096 - 3 * sizeof(void*));
+    EXPECT_EQ(stats.page_bytes, 4096 + 8192);
+}
+
+TEST(allocator, stats_padding) {
+    StackAllocator<char> alloc;
+    StackAllocator<char>::rebind<std::max_align_t>::other aligned(alloc);
+    alloc.allocate(1);
+    aligned.allocate(1);
+
+    EXPECT_EQ(alloc.stats().padding_bytes, alignof(std::max_align_t) - sizeof(void*));
+}
+
+TEST(allocator, stats_queue) {
+    StackAllocator<int> alloc;
+    XorList<int, StackAllocator<int> > list(alloc);
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+    }
+    size_t pages = alloc.stats().pages;
+    for (int i = 0; i < 100000; ++i) {
+        list.push_back(i);
+        list.pop_front();
+    }
+
+    EXPECT_EQ(alloc.stats().pages, pages);
+    EXPECT_EQ(alloc.stats().live_bytes, 1000 * sizeof(XorListNode<int>));
+    EXPECT_EQ(list.memory_footprint(), sizeof(list) + 1000 * sizeof(XorListNode<int>));
+}
+
+TEST(allocator, mmap_pages) {
+    ArenaConfig config;
+    config.source = MMAP_PAGES;
+    config.page_size = 1 << 16;
+    config.prefault = true;
+    StackAllocator<int> alloc(config);
+
+    int* x = alloc.allocate(100000);
+    x[0] = 1;
+    x[99999] = 2;
+    int* y = alloc.allocate(3);
+    y[2] = 3;
+
+    EXPECT_EQ(x[99999], 2);
+    EXPECT_EQ(alloc.stats().pages, 1);
+    EXPECT_EQ(alloc.stats().page_bytes, 7 * (1 << 16));
+}
+
+TEST(allocator, huge_pages) {
+    ArenaConfig config;
+    config.source = MMAP_PAGES;
+    config.huge_pages = true;
+    StackAllocator<int> alloc(config);
+    XorList<int, StackAllocator<int> > list(alloc);
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+    }
+
+    EXPECT_LT((size_t)&list.front() % (2 * 1024 * 1024), 64);
+    EXPECT_EQ(alloc.stats().page_bytes, 2 * 1024 * 1024);
+}
+
+TEST(allocator, page_growth) {
+    StackAllocator<int> alloc;
+    XorList<int, StackAllocator<int> > list(alloc);
+    for (int i = 0; i < 1000000; ++i) {
+        list.push_back(i);
+    }
+
+    AllocatorStats stats = alloc.stats();
+    EXPECT_LE(stats.pages, 15);
+    EXPECT_LT(stats.page_bytes, 2 * stats.live_bytes + 4096);
+}
+
+TEST(allocator, page_growth_limit) {
+    ArenaConfig config;
+    config.growth_factor = 4;
+    config.max_page_size = 1 << 16;
+    StackAllocator<char> alloc(config);
+    for (int i = 0; i < 100; ++i) {
+        alloc.allocate(1000);
+    }
+
+    AllocatorStats stats = alloc.stats();
+    EXPECT_EQ(stats.pages, 4);
+    EXPECT_EQ(stats.page_bytes, 4096 + 16384 + 2 * 65536);
+}
+
+TEST(allocator, rewind) {
+    StackAllocator<int> alloc;
+    int* kept = alloc.allocate(1);
+    *kept = 7;
+    RealAllocator::Marker marker = alloc.arena().mark();
+    int* first = alloc.allocate(1);
+    for (int i = 0; i < 10000; ++i) {
+        alloc.allocate(10);
+    }
+    size_t pages = alloc.stats().pages;
+    alloc.arena().rewind(marker);
+
+    EXPECT_EQ(alloc.stats().pages, 1);
+    EXPECT_EQ(alloc.stats().live_bytes, sizeof(void*));
+    EXPECT_EQ(alloc.allocate(1), first);
+    for (int i = 0; i < 10000; ++i) {
+        alloc.allocate(10);
+    }
+    EXPECT_EQ(alloc.stats().pages, pages);
+    EXPECT_EQ(*kept, 7);
+}
+
+TEST(allocator, reset) {
+    StackAllocator<int> alloc;
+    int* first = alloc.allocate(1);
+    alloc.allocate(100000);
+    alloc.arena().reset();
+
+    EXPECT_EQ(alloc.stats().pages, 0);
+    EXPECT_EQ(alloc.stats().live_bytes, 0);
+    EXPECT_EQ(alloc.allocate(1), first);
+}
+
+TEST(allocator, rewind_big_blocks) {
+    StackAllocator<char> alloc;
+    RealAllocator& arena = alloc.arena();
+    auto marker = arena.mark();
+    char* big = alloc.allocate(100000);
+    alloc.deallocate(big, 100000);
+    EXPECT_EQ(arena.free_blocks(100000, 10), 1);
+    arena.rewind(marker);
+
+    // The page is spare now and no free list may hand it out as well.
+    EXPECT_EQ(arena.free_blocks(100000, 10), 0);
+    char* first = alloc.allocate(100000);
+    char* second = alloc.allocate(100000);
+    EXPECT_TRUE(second >= first + 100000 or first >= second + 100000);
+    EXPECT_EQ(alloc.stats().pages, 2);
+    EXPECT_EQ(alloc.stats().dead_bytes, 0);
+}
+
+TEST(allocator, spare_pages) {
+    StackAllocator<char> alloc;
+    char* first = alloc.allocate(1);
+    alloc.allocate(6000);
+    alloc.allocate(12000);
+    alloc.arena().reset();
+    // Takes the biggest page, which goes back ahead of the smaller ones.
+    alloc.allocate(10000);
+    alloc.arena().reset();
+
+    EXPECT_EQ(alloc.allocate(1), first);
+    EXPECT_EQ(alloc.stats().page_bytes, 4096);
+}
+
+TEST(allocator, arena_scope) {
+    StackAllocator<int> alloc;
+    XorList<int, StackAllocator<int> > kept(alloc);
+    kept.push_back(1);
+    for (int round = 0; round < 3; ++round) {
+        ArenaScope scope(alloc.arena());
+        XorList<int, StackAllocator<int> > list(alloc);
+        for (int i = 0; i < 10000; ++i) {
+            list.push_back(i);
+        }
+        EXPECT_EQ(list.back(), 9999);
+    }
+
+    EXPECT_EQ(alloc.stats().live_bytes, sizeof(XorListNode<int>));
+    EXPECT_EQ(kept.front(), 1);
+    kept.push_back(2);
+    EXPECT_EQ(kept.back(), 2);
+}
+
+TEST(allocator, fixed_pages) {
+    ArenaConfig config;
+    config.growth_factor = 1;
+    StackAllocator<char> alloc(config);
+    for (int i = 0; i < 100; ++i) {
+        alloc.allocate(1000);
+    }
+
+    EXPECT_EQ(alloc.stats().pages, 25);
+    EXPECT_EQ(alloc.stats().page_bytes, 25 * 4096);
+}
+
 //-----------------------------------------------------------------------------
 
 namespace list_test {
@@ -150,6 +497,26 @@ TEST(list, stack_alloc) {
     EXPECT_EQ(list.back(), 4);
 }
 
+TEST(list, shared_allocator) {
+    StackAllocator<int> alloc;
+    XorList<int, StackAllocator<int> > l1(alloc);
+    XorList<int, StackAllocator<int> > l2(2, 7, alloc);
+    l1.push_back(1);
+
+    EXPECT_TRUE(l1.get_allocator() == alloc);
+    EXPECT_TRUE(l2.get_allocator() == alloc);
+
+    l1.swap(l2);
+    EXPECT_EQ(l1.size(), 2);
+    EXPECT_EQ(l1.back(), 7);
+    EXPECT_EQ(l2.front(), 1);
+
+    l2 = std::move(l1);
+    EXPECT_EQ(l1.size(), 0);
+    EXPECT_EQ(l2.size(), 2);
+    EXPECT_TRUE(l2.get_allocator() == alloc);
+}
+
 TEST(list, push_copy) {
     Checker::events.clear();
     XorList<Checker> list;
@@ -235,69 +602,1574 @@ TEST(list, insert_after) {
     list_test::check_list_element(list, 3, 4);
 }
 
-//------------------------------------------------------------------------
+namespace list_test {
 
-TEST(iterator, begin) {
-    XorList<int> list = list_test::gen_list(4);
+    template <typename T, class Alloc>
+    vector<T> to_vector(XorList<T, Alloc>& list) {
+        vector<T> result;
+        for (auto it = list.begin(); it != list.end(); ++it) {
+            result.push_back(*it);
+        }
+        return result;
+    }
 
-    EXPECT_EQ(*list.begin(), 0);
 }
 
-TEST(iterator, end) {
-    XorList<int> list = list_test::gen_list(5);
+TEST(list, reverse) {
+    XorList<int> list = list_test::gen_list(4);
+    list.reverse();
+    list.push_back(-1);
+
+    vector<int> answer = {3, 2, 1, 0, -1};
+    EXPECT_EQ(list_test::to_vector(list), answer);
+
     auto it = list.end();
     --it;
-    EXPECT_EQ(*it, 4);
+    --it;
+    EXPECT_EQ(*it, 0);
 }
 
-TEST(iterator, next) {
+TEST(list, splice) {
     XorList<int> list = list_test::gen_list(3);
-    int i = 0;
-    for (int &it : list) {
-        EXPECT_EQ(it, i);
-        ++i;
-    }
-    EXPECT_EQ(i, 3);
+    XorList<int> other = list_test::gen_list(2);
+    auto it = list.begin();
+    ++it;
+    list.splice(it, other);
+
+    vector<int> answer = {0, 0, 1, 1, 2};
+    EXPECT_EQ(list_test::to_vector(list), answer);
+    EXPECT_EQ(list.size(), 5);
+    EXPECT_EQ(other.size(), 0);
+
+    list.splice(list.begin(), other);
+    EXPECT_EQ(list.size(), 5);
 }
 
-TEST(iterator, prev) {
+TEST(list, splice_range) {
+    XorList<int> list = list_test::gen_list(3);
+    XorList<int> other = list_test::gen_list(5);
+    auto first = other.begin();
+    ++first;
+    auto last = first;
+    ++last;
+    ++last;
+    list.splice(list.end(), other, first, last);
+
+    vector<int> answer = {0, 1, 2, 1, 2};
+    EXPECT_EQ(list_test::to_vector(list), answer);
+    answer = {0, 3, 4};
+    EXPECT_EQ(list_test::to_vector(other), answer);
+    EXPECT_EQ(list.size(), 5);
+    EXPECT_EQ(other.size(), 3);
+
+    first = list.end();
+    --first;
+    --first;
+    list.splice(list.begin(), list, first, list.end());
+    answer = {1, 2, 0, 1, 2};
+    EXPECT_EQ(list_test::to_vector(list), answer);
+    EXPECT_EQ(list.size(), 5);
+}
+
+TEST(list, append) {
+    Checker::events.clear();
+    XorList<Checker> list(2);
+    XorList<Checker> other(3);
+    size_t events = Checker::events.size();
+
+    list.append(std::move(other));
+    EXPECT_EQ(list.size(), 5);
+    EXPECT_EQ(other.size(), 0);
+    EXPECT_EQ(Checker::events.size(), events);
+}
+
+TEST(list, construct_range) {
+    vector<int> values = {5, 6, 7};
+    XorList<int> list(values.begin(), values.end());
+    XorList<int> copy(list.begin(), list.end());
+    XorList<int> init = {5, 6, 7};
+
+    EXPECT_EQ(list_test::to_vector(list), values);
+    EXPECT_EQ(list_test::to_vector(copy), values);
+    EXPECT_EQ(list_test::to_vector(init), values);
+}
+
+TEST(list, batch_allocation) {
+    XorList<int, StackAllocator<int> > list = {1, 2, 3};
+    auto it = list.begin();
+    int* first = &*it;
+    ++it;
+    EXPECT_EQ((char*)&*it - (char*)first, sizeof(XorListNode<int>));
+
+    list.pop_front();
+    list.push_back(4);
+    EXPECT_EQ(&list.back(), first);
+}
+
+TEST(list, insert_range) {
+    XorList<int> list = list_test::gen_list(3);
+    vector<int> values = {10, 11};
+    auto it = list.begin();
+    ++it;
+    it = list.insert(it, values.begin(), values.end());
+    EXPECT_EQ(*it, 1);
+
+    vector<int> answer = {0, 10, 11, 1, 2};
+    EXPECT_EQ(list_test::to_vector(list), answer);
+    EXPECT_EQ(list.size(), 5);
+
+    list.assign({3, 4});
+    answer = {3, 4};
+    EXPECT_EQ(list_test::to_vector(list), answer);
+    EXPECT_EQ(list.size(), 2);
+}
+
+TEST(list, pop_front_n) {
     XorList<int> list = list_test::gen_list(5);
-    auto it = list.end();
-    int i = 4;
-    for (; i >= 0; --i) {
-        --it;
-        EXPECT_EQ(*it, i);
+    vector<int> out;
+    list.pop_front_n(2, std::back_inserter(out));
+
+    vector<int> answer = {0, 1};
+    EXPECT_EQ(out, answer);
+    EXPECT_EQ(list.size(), 3);
+    EXPECT_EQ(list.front(), 2);
+
+    list.push_front(1);
+    list.drain_into(out);
+    answer = {0, 1, 1, 2, 3, 4};
+    EXPECT_EQ(out, answer);
+    EXPECT_EQ(list.size(), 0);
+
+    list.push_back(7);
+    EXPECT_EQ(list.front(), 7);
+}
+
+namespace list_test {
+
+    // Throws on the write after limit ones.
+    struct LimitedOutput {
+        vector<int>* out;
+        size_t limit;
+
+        LimitedOutput& operator*() { return *this; }
+        LimitedOutput& operator++() { return *this; }
+        LimitedOutput& operator=(int value) {
+            if (out->size() == limit)
+                throw YException("LimitedOutput: full");
+            out->push_back(value);
+            return *this;
+        }
+    };
+
+    // Throws bad_alloc once *left allocations are used up. Copies with
+    // other counters aren't equal and don't propagate on move.
+    template <typename T>
+    struct LimitedAllocator : std::allocator<T> {
+        typedef std::false_type propagate_on_container_move_assignment;
+        size_t* left;
+
+        template <typename U>
+        struct rebind { typedef LimitedAllocator<U> other; };
+
+        explicit LimitedAllocator(size_t* left): left(left) {}
+        template <typename U>
+        LimitedAllocator(const LimitedAllocator<U>& other): left(other.left) {}
+
+        T* allocate(size_t size) {
+            if (*left == 0)
+                throw std::bad_alloc();
+            --*left;
+            return std::allocator<T>::allocate(size);
+        }
+        template <typename U>
+        bool operator==(const LimitedAllocator<U>& other) const { return left == other.left; }
+    };
+
+}
+
+TEST(list, pop_front_n_throw) {
+    XorList<int> list = list_test::gen_list(5);
+    vector<int> out;
+    EXPECT_THROW(list.pop_front_n(4, list_test::LimitedOutput{&out, 2}), YException);
+
+    vector<int> answer = {2, 3, 4};
+    EXPECT_EQ(list_test::to_vector(list), answer);
+    EXPECT_EQ(list.size(), 3);
+    list.pop_back();
+    list.pop_front();
+    EXPECT_EQ(list.front(), 3);
+    EXPECT_EQ(list.back(), 3);
+}
+
+TEST(list, sort) {
+    Checker::events.clear();
+    XorList<std::pair<int, int> > list;
+    for (int i = 0; i < 100; ++i) {
+        list.push_back(std::make_pair(i * 37 % 10, i));
     }
+    auto pairs = list_test::to_vector(list);
+
+    auto by_first = [](const std::pair<int, int>& a, const std::pair<int, int>& b) {
+        return a.first < b.first;
+    };
+    list.sort(by_first);
+    std::stable_sort(pairs.begin(), pairs.end(), by_first);
+    EXPECT_EQ(list_test::to_vector(list), pairs);
+    EXPECT_EQ(list.size(), 100);
+
+    list.push_back(std::make_pair(-1, -1));
+    EXPECT_EQ(list.back().first, -1);
 }
 
-TEST(iterator, equial) {
-    XorList<int> list(4);
-    auto it1 = list.begin();
-    auto it2 = list.begin();
-    EXPECT_TRUE(it1 == it2);
-    EXPECT_FALSE(it1 != it2);
+TEST(list, sort_keeps_values) {
+    XorList<Checker> list(5);
+    Checker::events.clear();
+    list.sort([](const Checker&, const Checker&) { return false; });
+    EXPECT_TRUE(Checker::events.empty());
+}
 
-    it1++;
-    EXPECT_TRUE(it1 != it2);
-    EXPECT_FALSE(it1 == it2);
+TEST(list, parallel_sort) {
+    vector<int> values;
+    for (int i = 0; i < 10007; ++i) {
+        values.push_back(rand() % 1000);
+    }
+    XorList<int> list(values.begin(), values.end());
+    list.sort(std::greater<int>(), 0, 4);
+    std::sort(values.begin(), values.end(), std::greater<int>());
 
-    it2++;
-    EXPECT_TRUE(it1 == it2);
-    EXPECT_FALSE(it1 != it2);
+    EXPECT_EQ(list_test::to_vector(list), values);
 
-    auto it3 = list.end();
-    for (int i = 0; i < 3; ++i) --it3;
-    EXPECT_TRUE(it1 == it3);
-    EXPECT_FALSE(it1 != it3);
+    XorList<int> small = {3, 1, 2};
+    small.sort(std::less<int>(), 0, 8);
+    vector<int> answer = {1, 2, 3};
+    EXPECT_EQ(list_test::to_vector(small), answer);
 }
 
-TEST(auto_tests, check_is_equial) {
-    size_t size = 20;
-    int count = 10000;
-    for (int i = 0; i < count; ++i) {
-        bool ok = check_is_equial<int,
-                std::list<int>,
-                XorList<int, StackAllocator<int> > >(size);
-        EXPECT_TRUE(ok);
+TEST(list, merge_unique) {
+    XorList<int> list = {1, 3, 3, 5};
+    XorList<int> other = {2, 3, 6};
+    list.merge(std::move(other));
+
+    vector<int> answer = {1, 2, 3, 3, 3, 5, 6};
+    EXPECT_EQ(list_test::to_vector(list), answer);
+    EXPECT_EQ(list.size(), 7);
+    EXPECT_EQ(other.size(), 0);
+
+    list.push_back(6);
+    list.unique();
+    answer = {1, 2, 3, 5, 6};
+    EXPECT_EQ(list_test::to_vector(list), answer);
+    EXPECT_EQ(list.size(), 5);
+    EXPECT_EQ(list.back(), 6);
+}
+
+TEST(list, sort_throw) {
+    std::atomic<int> calls(0);
+    int limit = 0;
+    auto comp = [&calls, &limit](int a, int b) {
+        if (++calls > limit)
+            throw YException("comp: limit");
+        return a < b;
+    };
+    auto check_kept = [](XorList<int>& list, vector<int> values) {
+        vector<int> kept = list_test::to_vector(list);
+        std::sort(kept.begin(), kept.end());
+        std::sort(values.begin(), values.end());
+        EXPECT_EQ(kept, values);
+        EXPECT_EQ(list.size(), values.size());
+
+        vector<int> backward;
+        for (auto it = list.end(); it != list.begin();) {
+            backward.push_back(*--it);
+        }
+        std::reverse(backward.begin(), backward.end());
+        EXPECT_EQ(backward, list_test::to_vector(list));
+    };
+
+    vector<int> values;
+    for (int i = 0; i < 1000; ++i) {
+        values.push_back(i * 7919 % 1000);
+    }
+    for (int limit_value : {0, 10, 500, 5000}) {
+        limit = limit_value;
+
+        XorList<int> list(values.begin(), values.end());
+        calls = 0;
+        EXPECT_THROW(list.sort(comp), YException);
+        check_kept(list, values);
+
+        calls = 0;
+        EXPECT_THROW(list.sort(comp, 0, 4), YException);
+        check_kept(list, values);
+    }
+
+    limit = 0;
+    calls = 0;
+    XorList<int> list(values.begin(), values.end());
+    XorList<int> other = {1, 2, 3};
+    EXPECT_THROW(list.merge(std::move(other), comp), YException);
+    values.insert(values.end(), {1, 2, 3});
+    check_kept(list, values);
+    EXPECT_EQ(other.size(), 0);
+}
+
+TEST(list, clear) {
+    XorList<int> list = {1, 2, 3};
+    list.clear();
+    EXPECT_EQ(list.size(), 0);
+    EXPECT_EQ(list.begin(), list.end());
+
+    list.push_back(4);
+    EXPECT_EQ(list.front(), 4);
+    EXPECT_EQ(list.back(), 4);
+}
+
+TEST(list, clear_arena) {
+    StackAllocator<int> alloc;
+    XorList<int, StackAllocator<int> > list(alloc);
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+    }
+    size_t page_bytes = alloc.stats().page_bytes;
+    list.clear();
+
+    EXPECT_EQ(list.size(), 0);
+    EXPECT_EQ(alloc.stats().live_bytes, 0);
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+    }
+    EXPECT_EQ(alloc.stats().dead_bytes, 0);
+
+    EXPECT_EQ(alloc.stats().page_bytes, page_bytes);
+
+    // The moved-in list is built while the old one is alive.
+    vector<int> values(1000, 1);
+    list = XorList<int, StackAllocator<int> >(values.begin(), values.end(), alloc);
+    page_bytes = alloc.stats().page_bytes;
+    for (int i = 0; i < 1000; ++i) {
+        list.assign(values.begin(), values.end());
+        list = XorList<int, StackAllocator<int> >(values.begin(), values.end(), alloc);
+    }
+    EXPECT_EQ(alloc.stats().page_bytes, page_bytes);
+    EXPECT_EQ(list.back(), 1);
+}
+
+TEST(list, clear_owned_arena) {
+    XorList<int, StackAllocator<int> > list;
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+    }
+    size_t page_bytes = list.get_allocator().stats().page_bytes;
+    list.clear();
+
+    // Freed one by one, the nodes would count as dead.
+    EXPECT_EQ(list.get_allocator().stats().live_bytes, 0);
+    EXPECT_EQ(list.get_allocator().stats().dead_bytes, 0);
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+    }
+    EXPECT_EQ(list.get_allocator().stats().page_bytes, page_bytes);
+    EXPECT_EQ(list.back(), 999);
+
+    auto alloc = list.get_allocator();
+    list.clear();
+    EXPECT_EQ(alloc.stats().dead_bytes, 1000 * sizeof(XorListNode<int>));
+}
+
+TEST(list, abandon) {
+    StackAllocator<int> alloc;
+    XorList<int, StackAllocator<int> > list(alloc);
+    auto marker = alloc.arena().mark();
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+    }
+    list.abandon();
+
+    EXPECT_EQ(list.size(), 0);
+    EXPECT_EQ(alloc.stats().live_bytes, 0);
+    EXPECT_EQ(alloc.stats().dead_bytes, 1000 * sizeof(XorListNode<int>));
+    alloc.arena().rewind(marker);
+    EXPECT_EQ(alloc.stats().dead_bytes, 0);
+    list.push_back(1);
+    EXPECT_EQ(list.front(), 1);
+}
+
+TEST(list, clear_destroys) {
+    XorList<Checker, StackAllocator<Checker> > list(2);
+    Checker::events.clear();
+    list.clear();
+
+    vector<CheckerEvent> answer = {DESTRUCT, DESTRUCT};
+    EXPECT_EQ(Checker::events, answer);
+}
+
+TEST(list, erase) {
+    XorList<int> list = list_test::gen_list(10);
+
+    auto it = list.erase(list.iterator_at(3));
+    EXPECT_EQ(*it, 4);
+    it = list.erase(it, list.advance(it, 3));
+    EXPECT_EQ(*it, 7);
+    EXPECT_EQ(*--it, 2);
+    it = list.erase(list.iterator_at(5));
+    EXPECT_TRUE(it == list.end());
+    EXPECT_EQ(list_test::to_vector(list), vector<int>({0, 1, 2, 7, 8}));
+
+    it = list.erase(list.begin(), list.begin());
+    EXPECT_EQ(*it, 0);
+    it = list.erase(list.begin(), list.end());
+    EXPECT_TRUE(it == list.end());
+    EXPECT_EQ(list.size(), 0);
+    list.push_back(1);
+    EXPECT_EQ(list.front(), 1);
+
+    XorList<Checker> checkers(5);
+    Checker::events.clear();
+    checkers.erase(checkers.iterator_at(1), checkers.iterator_at(4));
+    EXPECT_EQ(Checker::events, vector<CheckerEvent>(3, DESTRUCT));
+    EXPECT_EQ(checkers.size(), 2);
+}
+
+TEST(list, remove_if) {
+    XorList<int> list = list_test::gen_list(20);
+
+    EXPECT_EQ(list.remove_if([](int value) { return value % 3 != 1; }), 13);
+    EXPECT_EQ(list_test::to_vector(list), vector<int>({1, 4, 7, 10, 13, 16, 19}));
+    EXPECT_EQ(list.back(), 19);
+    EXPECT_EQ(*--list.end(), 19);
+
+    // The value may live in a node that is being erased.
+    list.push_back(4);
+    EXPECT_EQ(list.remove(*list.iterator_at(1)), 2);
+    EXPECT_EQ(list_test::to_vector(list), vector<int>({1, 7, 10, 13, 16, 19}));
+    EXPECT_EQ(list.remove(5), 0);
+
+    int calls = 0;
+    EXPECT_THROW(list.remove_if([&calls](int value) {
+        if (++calls == 4)
+            throw YException("stop");
+        return value < 10;
+    }), YException);
+    EXPECT_EQ(list_test::to_vector(list), vector<int>({10, 13, 16, 19}));
+    EXPECT_EQ(*--list.end(), 19);
+
+    EXPECT_EQ(list.remove_if([](int) { return true; }), 4);
+    EXPECT_EQ(list.size(), 0);
+    EXPECT_TRUE(list.begin() == list.end());
+}
+
+TEST(list, save_load) {
+    XorList<int> list;
+    for (int i = 0; i < 100000; ++i) {
+        list.push_back(i);
+    }
+    std::stringstream stream;
+    list.save(stream);
+
+    StackAllocator<int> alloc;
+    XorList<int, StackAllocator<int> > loaded(alloc);
+    loaded.push_back(-1);
+    loaded.load(stream);
+
+    EXPECT_EQ(loaded.size(), 100000);
+    EXPECT_EQ(loaded.front(), 0);
+    EXPECT_EQ(loaded.back(), 99999);
+    EXPECT_TRUE(std::equal(list.begin(), list.end(), loaded.begin()));
+}
+
+TEST(list, load_errors) {
+    XorList<int> list = {1, 2, 3};
+    std::stringstream stream;
+    list.save(stream);
+    std::string dump = stream.str();
+
+    XorList<int> loaded = {7};
+    std::stringstream cut(dump.substr(0, dump.size() - 1));
+    EXPECT_THROW(loaded.load(cut), YException);
+    std::stringstream garbage("not a dump at all, not at all");
+    EXPECT_THROW(loaded.load(garbage), YException);
+    XorList<double> other;
+    std::stringstream wrong_type(dump);
+    EXPECT_THROW(other.load(wrong_type), YException);
+
+    EXPECT_EQ(list_test::to_vector(loaded), vector<int>{7});
+}
+
+namespace list_test {
+    // Can't seek, like a pipe.
+    class StreamBuffer: public std::streambuf {
+    public:
+        explicit StreamBuffer(std::string data): _data(std::move(data)) {
+            setg(&_data[0], &_data[0], &_data[0] + _data.size());
+        }
+
+    private:
+        std::string _data;
+    };
+}
+
+TEST(list, load_huge_count) {
+    XorList<int, StackAllocator<int> > list = {1, 2, 3};
+    std::stringstream stream;
+    list.save(stream);
+    std::string dump = stream.str();
+
+    XorList<int, StackAllocator<int> > loaded = {7};
+    for (uint64_t count : {(uint64_t)4, (uint64_t)1 << 40, ~(uint64_t)0}) {
+        std::string damaged = dump;
+        memcpy(&damaged[offsetof(XorListDumpHeader, count)], &count, sizeof(count));
+        std::stringstream seekable(damaged);
+        EXPECT_THROW(loaded.load(seekable), YException);
+        list_test::StreamBuffer buffer(damaged);
+        std::istream pipe(&buffer);
+        EXPECT_THROW(loaded.load(pipe), YException);
+    }
+    EXPECT_EQ(list_test::to_vector(loaded), vector<int>{7});
+    EXPECT_LT(loaded.get_allocator().stats().page_bytes, (size_t)1 << 20);
+}
+
+TEST(list, dump_reader) {
+    XorList<int> list;
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+    }
+    std::stringstream stream;
+    list.save(stream);
+
+    XorListDumpReader<int> reader(stream);
+    EXPECT_EQ(reader.size(), 1000);
+    int chunk[64];
+    int expected = 0;
+    size_t read;
+    while ((read = reader.read(chunk, 64)) != 0) {
+        for (size_t i = 0; i < read; ++i) {
+            EXPECT_EQ(chunk[i], expected++);
+        }
+    }
+    EXPECT_EQ(expected, 1000);
+    EXPECT_EQ(reader.remaining(), 0);
+}
+
+TEST(list, iterator_at) {
+    XorList<int> list = list_test::gen_list(10);
+
+    EXPECT_EQ(*list.iterator_at(0), 0);
+    EXPECT_EQ(*list.iterator_at(3), 3);
+    EXPECT_EQ(*list.iterator_at(8), 8);
+    EXPECT_EQ(list.iterator_at(10), list.end());
+    EXPECT_EQ(list.at(9), 9);
+    EXPECT_THROW(list.at(10), YException);
+
+    auto it = list.iterator_at(7);
+    --it;
+    EXPECT_EQ(*it, 6);
+    EXPECT_EQ(*list.advance(it, -4), 2);
+}
+
+TEST(list, at_after_insert) {
+    XorList<int> list(5, 4);
+    list.set_finger_cache(true);
+    EXPECT_EQ(list.at(2), 4);
+
+    auto it = list.begin();
+    ++it;
+    it = list.insert_before(it, 3);
+    list.insert_before(it, 10);
+    list.push_front(1);
+
+    vector<int> expected = {1, 4, 3, 10, 4, 4, 4, 4};
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(list.at(i), expected[i]);
+        list_test::check_list_element(list, (int)i, expected[i]);
+    }
+    EXPECT_EQ(list.at(2), 3);
+}
+
+TEST(list, finger_cache) {
+    XorList<int> list = list_test::gen_list(1000);
+    list.set_finger_cache(true);
+
+    for (size_t i = 0; i < 1000; ++i) {
+        EXPECT_EQ(list.at(i), (int)i);
+    }
+    EXPECT_EQ(list.at(400), 400);
+    EXPECT_EQ(list.at(600), 600);
+
+    // A change in the list must not leave the finger pointing to stale nodes.
+    list.erase(list.iterator_at(500));
+    list.push_front(-1);
+    EXPECT_EQ(list.at(500), 499);
+    EXPECT_EQ(list.at(501), 501);
+    list.reverse();
+    EXPECT_EQ(list.at(499), 499);
+}
+
+TEST(list, internal_iteration) {
+    XorList<int> list = list_test::gen_list(1000);
+
+    for (size_t distance : {0, 1, 8, 5000}) {
+        EXPECT_EQ(list.accumulate(0LL, std::plus<long long>(), distance), 999LL * 1000 / 2);
+
+        auto it = list.find_if([](int value) { return value == 700; }, distance);
+        EXPECT_EQ(*it, 700);
+        EXPECT_EQ(*++it, 701);
+        EXPECT_TRUE(list.find_if([](int value) { return value < 0; }, distance) == list.end());
+    }
+
+    list.for_each([](int& value) { value *= 2; });
+    int expected = 0;
+    for (int value : list.forward_range()) {
+        EXPECT_EQ(value, expected);
+        expected += 2;
+    }
+    EXPECT_EQ(expected, 2000);
+
+    XorList<int> empty;
+    EXPECT_EQ(empty.accumulate(0), 0);
+    EXPECT_TRUE(empty.find_if([](int) { return true; }) == empty.end());
+    EXPECT_TRUE(empty.forward_range().begin() == empty.forward_range().end());
+}
+
+TEST(list, compact) {
+    StackAllocator<int> alloc;
+    XorList<int, StackAllocator<int> > list(alloc);
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+        list.push_front(-i);
+    }
+    for (size_t i = list.size(); i-- > 0; ) {
+        if (i % 3 == 0) {
+            list.erase(list.iterator_at(i));
+        }
+        else if (i % 5 == 0) {
+            list.insert_before(list.iterator_at(i), (int)i);
+        }
+    }
+    auto before = list_test::to_vector(list);
+
+    list.compact();
+    EXPECT_EQ(list_test::to_vector(list), before);
+    auto prev = list.begin();
+    for (auto it = std::next(prev); it != list.end(); ++prev, ++it) {
+        EXPECT_EQ((char*)&*it - (char*)&*prev, sizeof(XorListNode<int>));
+    }
+}
+
+TEST(list, compact_out_of_memory) {
+    size_t left = 100;
+    XorList<std::string, list_test::LimitedAllocator<std::string> > list{
+            list_test::LimitedAllocator<std::string>(&left)};
+    vector<std::string> expected;
+    for (int i = 0; i < 10; ++i) {
+        expected.push_back(std::string(50, (char)('a' + i)));
+        list.push_back(expected.back());
+    }
+
+    left = 5;
+    EXPECT_THROW(list.compact(), std::bad_alloc);
+    EXPECT_EQ(list_test::to_vector(list), expected);
+    EXPECT_THROW(list.compact_step(7), std::bad_alloc);
+    EXPECT_EQ(list_test::to_vector(list), expected);
+
+    left = 10;
+    list.compact();
+    EXPECT_EQ(list_test::to_vector(list), expected);
+}
+
+TEST(list, move_assign_unequal) {
+    typedef list_test::LimitedAllocator<int> Limited;
+    EXPECT_TRUE(std::is_nothrow_move_assignable<XorList<int> >::value);
+    EXPECT_TRUE((std::is_nothrow_move_assignable<XorList<int, StackAllocator<int> > >::value));
+    EXPECT_FALSE((std::is_nothrow_move_assignable<XorList<int, Limited> >::value));
+    EXPECT_FALSE((std::is_nothrow_move_assignable<XorIndexList<int, Limited> >::value));
+
+    size_t left = 100, other_left = 100;
+    XorList<int, Limited> list{Limited(&left)};
+    XorList<int, Limited> other({1, 2, 3}, Limited(&other_left));
+    left = 2;
+    EXPECT_THROW(list = std::move(other), std::bad_alloc);
+    left = 100;
+    list = std::move(other);
+    EXPECT_EQ(list_test::to_vector(list), (vector<int>{1, 2, 3}));
+}
+
+TEST(list, compact_step) {
+    XorList<int> list = list_test::gen_list(100);
+    vector<int> expected = list_test::to_vector(list);
+
+    EXPECT_FALSE(list.compact_step(30));
+    EXPECT_FALSE(list.compact_step(30));
+    // A change between steps sends the next one to the same index.
+    list.erase(list.iterator_at(10));
+    list.push_front(-1);
+    expected.erase(expected.begin() + 10);
+    expected.insert(expected.begin(), -1);
+    EXPECT_FALSE(list.compact_step(30));
+    EXPECT_TRUE(list.compact_step(30));
+    EXPECT_EQ(list_test::to_vector(list), expected);
+
+    EXPECT_FALSE(list.compact_step(99));
+    EXPECT_TRUE(list.compact_step(99));
+    EXPECT_EQ(list_test::to_vector(list), expected);
+
+    XorList<Checker> checkers(5);
+    Checker::events.clear();
+    checkers.compact();
+    EXPECT_EQ(std::count(Checker::events.begin(), Checker::events.end(), CONSTRUCT_MOVE), 5);
+    EXPECT_EQ(std::count(Checker::events.begin(), Checker::events.end(), DESTRUCT), 5);
+
+    XorList<int> empty;
+    empty.compact();
+    EXPECT_TRUE(empty.compact_step(10));
+}
+
+TEST(list, emplace) {
+    XorList<std::pair<int, std::string> > list;
+    list.emplace_back(2, "b");
+    list.emplace_front(1, "a");
+    auto it = list.emplace(list.end(), 4, "d");
+    EXPECT_EQ(it->first, 4);
+    it = list.emplace(it, 3, "c");
+    EXPECT_EQ(it->second, "c");
+    list.emplace_back();
+
+    vector<std::pair<int, std::string> > expected = {{1, "a"}, {2, "b"}, {3, "c"}, {4, "d"}, {0, ""}};
+    EXPECT_EQ(list_test::to_vector(list), expected);
+
+    XorList<Checker> checkers;
+    Checker::events.clear();
+    checkers.emplace_back();
+    EXPECT_EQ(Checker::events, vector<CheckerEvent>({CONSTRUCT_DEFAULT}));
+}
+
+TEST(list, node_handle) {
+    StackAllocator<Checker> alloc;
+    XorList<Checker, StackAllocator<Checker> > first(alloc), second(alloc);
+    for (int i = 0; i < 3; ++i) {
+        first.emplace_back();
+    }
+
+    Checker::events.clear();
+    auto handle = first.extract(first.iterator_at(1));
+    Checker* moved = &handle.value();
+    EXPECT_EQ(first.size(), 2);
+    auto it = second.insert(second.end(), std::move(handle));
+    EXPECT_TRUE(handle.empty());
+    EXPECT_EQ(&*it, moved);
+    EXPECT_EQ(second.size(), 1);
+
+    // A parked node goes back to its list as well.
+    auto parked = second.extract(second.begin());
+    it = first.insert(first.begin(), std::move(parked));
+    EXPECT_EQ(&*it, moved);
+    EXPECT_EQ(first.size(), 3);
+    EXPECT_TRUE(Checker::events.empty());
+
+    {
+        auto dropped = first.extract(first.begin());
+        EXPECT_TRUE((bool)dropped);
+    }
+    EXPECT_EQ(Checker::events, vector<CheckerEvent>({DESTRUCT}));
+
+    XorList<Checker, StackAllocator<Checker> >::node_type empty;
+    EXPECT_THROW(empty.value(), YException);
+    EXPECT_TRUE(first.insert(first.end(), std::move(empty)) == first.end());
+    EXPECT_EQ(first.size(), 2);
+}
+
+//------------------------------------------------------------------------
+
+TEST(iterator, begin) {
+    XorList<int> list = list_test::gen_list(4);
+
+    EXPECT_EQ(*list.begin(), 0);
+}
+
+TEST(iterator, end) {
+    XorList<int> list = list_test::gen_list(5);
+    auto it = list.end();
+    --it;
+    EXPECT_EQ(*it, 4);
+}
+
+TEST(iterator, next) {
+    XorList<int> list = list_test::gen_list(3);
+    int i = 0;
+    for (int &it : list) {
+        EXPECT_EQ(it, i);
+        ++i;
+    }
+    EXPECT_EQ(i, 3);
+}
+
+TEST(iterator, prev) {
+    XorList<int> list = list_test::gen_list(5);
+    auto it = list.end();
+    int i = 4;
+    for (; i >= 0; --i) {
+        --it;
+        EXPECT_EQ(*it, i);
+    }
+}
+
+TEST(iterator, equial) {
+    XorList<int> list(4);
+    auto it1 = list.begin();
+    auto it2 = list.begin();
+    EXPECT_TRUE(it1 == it2);
+    EXPECT_FALSE(it1 != it2);
+
+    it1++;
+    EXPECT_TRUE(it1 != it2);
+    EXPECT_FALSE(it1 == it2);
+
+    it2++;
+    EXPECT_TRUE(it1 == it2);
+    EXPECT_FALSE(it1 != it2);
+
+    auto it3 = list.end();
+    for (int i = 0; i < 3; ++i) --it3;
+    EXPECT_TRUE(it1 == it3);
+    EXPECT_FALSE(it1 != it3);
+}
+
+TEST(auto_tests, check_is_equial) {
+    size_t size = 20;
+    int count = 10000;
+    for (int i = 0; i < count; ++i) {
+        bool ok = check_is_equial<int,
+                std::list<int>,
+                XorList<int, StackAllocator<int> > >(size);
+        EXPECT_TRUE(ok);
+    }
+}
+
+TEST(auto_tests, positional_check_is_equial) {
+    size_t size = 40;
+    int count = 3000;
+    for (int i = 0; i < count; ++i) {
+        bool ok = check_positional_is_equial<int,
+                std::list<int>,
+                XorList<int, StackAllocator<int> > >(size);
+        EXPECT_TRUE(ok);
+    }
+}
+
+TEST(auto_tests, push_back_query) {
+    XorList<int> list;
+    QueryInput<int> push;
+    push.type = PUSH_BACK;
+    push.add.value = 1;
+    do_query(list, push);
+    push.add.value = 2;
+    do_query(list, push);
+
+    QueryInput<int> back;
+    back.type = BACK;
+    EXPECT_EQ(do_query(list, back).get.result, 2);
+}
+
+//------------------------------------------------------------------------
+
+TEST(concurrent_list, ends) {
+    ConcurrentXorList<int> list;
+    int value = 0;
+    EXPECT_FALSE(list.try_pop_front(value));
+
+    for (int i = 0; i < 6; ++i) {
+        list.push_back(i);
+    }
+    list.push_front(-1);
+    EXPECT_EQ(list.size(), 7);
+
+    EXPECT_TRUE(list.try_pop_front(value));
+    EXPECT_EQ(value, -1);
+    EXPECT_TRUE(list.try_pop_back(value));
+    EXPECT_EQ(value, 5);
+    for (int i = 0; i < 5; ++i) {
+        EXPECT_TRUE(list.try_pop_front(value));
+        EXPECT_EQ(value, i);
+    }
+    EXPECT_FALSE(list.try_pop_back(value));
+    EXPECT_TRUE(list.empty());
+}
+
+TEST(concurrent_list, producers_consumers) {
+    ConcurrentXorList<long long, ConcurrentStackAllocator<long long> > list;
+    std::atomic<long long> sum(0);
+    std::atomic<int> popped(0);
+    const int count = 20000;
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t < 2; ++t) {
+        threads.emplace_back([&list, t]() {
+            for (int i = 1; i <= count; ++i) {
+                if (t == 0) list.push_back(i);
+                else list.push_front(i);
+            }
+        });
+        threads.emplace_back([&list, &sum, &popped, t]() {
+            long long value;
+            while (popped.load() < 2 * count) {
+                bool ok = t == 0 ? list.try_pop_front(value) : list.try_pop_back(value);
+                if (ok) {
+                    sum += value;
+                    popped++;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    EXPECT_EQ(sum.load(), (long long)count * (count + 1));
+    EXPECT_TRUE(list.empty());
+}
+
+TEST(concurrent_list, contention_test) {
+    EXPECT_GE((contention_test<int, ConcurrentXorList<int> >(4, 1000)), 0.0);
+    EXPECT_GE((contention_test<int, MutexWrappedList<int, XorList<int> > >(4, 1000)), 0.0);
+}
+
+TEST(unrolled_list, push_pop) {
+    XorUnrolledList<int, 4> list;
+    for (int i = 0; i < 10; ++i) {
+        list.push_back(i);
+    }
+    list.push_front(-1);
+
+    EXPECT_EQ(list.size(), 11);
+    EXPECT_EQ(list.front(), -1);
+    EXPECT_EQ(list.back(), 9);
+
+    list.pop_front();
+    list.pop_back();
+    EXPECT_EQ(list.front(), 0);
+    EXPECT_EQ(list.back(), 8);
+}
+
+TEST(unrolled_list, iterate) {
+    XorUnrolledList<int, 3> list;
+    for (int i = 0; i < 20; ++i) {
+        list.push_back(i);
+    }
+
+    int i = 0;
+    for (int &value : list) {
+        EXPECT_EQ(value, i);
+        ++i;
+    }
+    EXPECT_EQ(i, 20);
+
+    auto it = list.end();
+    for (i = 19; i >= 0; --i) {
+        --it;
+        EXPECT_EQ(*it, i);
+    }
+}
+
+TEST(unrolled_list, insert_erase) {
+    XorUnrolledList<int, 2> list(4, 0);
+    auto it = list.begin();
+    ++it;
+    it = list.insert_before(it, 1);
+    it = list.insert_before(it, 2);
+    it = list.insert_after(it, 3);
+
+    std::vector<int> answer = {0, 1, 2, 0, 3, 0, 0};
+    EXPECT_EQ(vector<int>(list.begin(), list.end()), answer);
+
+    it = list.begin();
+    ++it;
+    it = list.erase(it);
+    it = list.erase(it);
+    EXPECT_EQ(*it, 0);
+
+    answer = {0, 0, 3, 0, 0};
+    EXPECT_EQ(vector<int>(list.begin(), list.end()), answer);
+}
+
+TEST(unrolled_list, insert_own_element) {
+    XorUnrolledList<std::string, 4> list;
+    list.push_back("alpha");
+    list.push_back("beta");
+    list.push_front(list.front());
+    list.push_back(list.back());
+
+    vector<std::string> answer = {"alpha", "alpha", "beta", "beta"};
+    EXPECT_EQ(vector<std::string>(list.begin(), list.end()), answer);
+
+    XorUnrolledList<std::string, 2> full;
+    full.push_back("alpha");
+    full.push_back("beta");
+    full.push_front(full.back());
+    answer = {"beta", "alpha", "beta"};
+    EXPECT_EQ(vector<std::string>(full.begin(), full.end()), answer);
+}
+
+TEST(unrolled_list, destroy) {
+    Checker::events.clear();
+    auto lptr = new XorUnrolledList<Checker, 2>(3);
+    delete lptr;
+
+    EXPECT_EQ(std::count(Checker::events.begin(), Checker::events.end(), DESTRUCT),
+              std::count_if(Checker::events.begin(), Checker::events.end(),
+                            [](CheckerEvent e) { return e != DESTRUCT; }));
+}
+
+TEST(auto_tests, unrolled_check_is_equial) {
+    size_t size = 20;
+    int count = 10000;
+    for (int i = 0; i < count; ++i) {
+        bool ok = check_is_equial<int,
+                std::list<int>,
+                XorUnrolledList<int, 4, StackAllocator<int> > >(size);
+        EXPECT_TRUE(ok);
+    }
+}
+
+//------------------------------------------------------------------------
+
+namespace intrusive_test {
+
+    struct Item {
+        int value;
+        Checker checker;
+        XorListHook hook;
+        XorListHook other_hook;
+
+        explicit Item(int value): value(value) {}
+    };
+
+    typedef IntrusiveXorList<Item, &Item::hook> ItemList;
+    typedef IntrusiveXorList<Item, &Item::other_hook> OtherItemList;
+
+    template <class List>
+    vector<int> values(List& list) {
+        vector<int> result;
+        for (auto& item : list) {
+            result.push_back(item.value);
+        }
+        return result;
+    }
+
+}
+
+TEST(intrusive_list, push_pop) {
+    std::deque<intrusive_test::Item> items;
+    for (int i = 0; i < 5; ++i) {
+        items.emplace_back(i);
+    }
+    Checker::events.clear();
+
+    intrusive_test::ItemList list;
+    for (auto& item : items) {
+        list.push_back(item);
+    }
+    list.pop_front();
+    list.pop_back();
+
+    vector<int> answer = {1, 2, 3};
+    EXPECT_EQ(intrusive_test::values(list), answer);
+    EXPECT_EQ(list.size(), 3);
+    EXPECT_EQ(&list.front(), &items[1]);
+    EXPECT_EQ(&list.back(), &items[3]);
+    EXPECT_TRUE(Checker::events.empty());
+}
+
+TEST(intrusive_list, two_hooks) {
+    std::deque<intrusive_test::Item> items;
+    intrusive_test::ItemList list;
+    intrusive_test::OtherItemList other;
+    for (int i = 0; i < 4; ++i) {
+        items.emplace_back(i);
+        list.push_back(items.back());
+        other.push_front(items.back());
+    }
+
+    vector<int> answer = {0, 1, 2, 3};
+    EXPECT_EQ(intrusive_test::values(list), answer);
+    answer = {3, 2, 1, 0};
+    EXPECT_EQ(intrusive_test::values(other), answer);
+
+    auto it = other.end();
+    --it;
+    EXPECT_EQ(&*it, &items[0]);
+}
+
+TEST(intrusive_list, insert_erase) {
+    std::deque<intrusive_test::Item> items;
+    for (int i = 0; i < 6; ++i) {
+        items.emplace_back(i);
+    }
+    intrusive_test::ItemList list;
+    list.push_back(items[0]);
+    list.push_back(items[1]);
+
+    auto it = list.begin();
+    ++it;
+    it = list.insert_before(it, items[2]);
+    it = list.insert_after(it, items[3]);
+    EXPECT_EQ(it->value, 1);
+
+    vector<int> answer = {0, 2, 1, 3};
+    EXPECT_EQ(intrusive_test::values(list), answer);
+
+    it = list.erase(list.begin());
+    EXPECT_EQ(it->value, 2);
+    it = list.erase(++it);
+    EXPECT_EQ(it->value, 3);
+    list.push_front(items[1]);
+
+    answer = {1, 2, 3};
+    EXPECT_EQ(intrusive_test::values(list), answer);
+    list.clear();
+    EXPECT_EQ(list.size(), 0);
+    EXPECT_EQ(list.begin(), list.end());
+}
+
+//------------------------------------------------------------------------
+
+TEST(index_list, push_pop) {
+    XorIndexList<int> list = {1, 2, 3};
+    list.push_front(0);
+    list.push_back(4);
+
+    EXPECT_EQ(vector<int>(list.begin(), list.end()), (vector<int>{0, 1, 2, 3, 4}));
+    list.pop_front();
+    list.pop_back();
+    EXPECT_EQ(list.front(), 1);
+    EXPECT_EQ(list.back(), 3);
+    EXPECT_EQ(list.size(), 3);
+
+    auto it = list.end();
+    --it;
+    --it;
+    EXPECT_EQ(*it, 2);
+}
+
+TEST(index_list, growth_keeps_iterators) {
+    XorIndexList<std::string> list;
+    list.push_back("first");
+    auto it = list.begin();
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(std::to_string(i));
+        list.push_back(list.front());
+    }
+
+    EXPECT_EQ(*it, "first");
+    EXPECT_EQ(list.size(), 2001);
+    EXPECT_EQ(list.back(), "first");
+    EXPECT_GE(list.capacity(), 2001);
+}
+
+TEST(index_list, reuse_slots) {
+    XorIndexList<int> list;
+    for (int i = 0; i < 100; ++i) {
+        list.push_back(i);
+    }
+    size_t capacity = list.capacity();
+    for (int i = 0; i < 10000; ++i) {
+        list.pop_front();
+        list.push_back(i);
+    }
+
+    EXPECT_EQ(list.capacity(), capacity);
+    EXPECT_EQ(list.front(), 9900);
+    EXPECT_EQ(list.back(), 9999);
+}
+
+TEST(index_list, insert_erase) {
+    XorIndexList<int> list(4, 0);
+    auto it = list.begin();
+    ++it;
+    it = list.insert_before(it, 1);
+    it = list.insert_after(it, 2);
+    list.erase(list.begin());
+
+    EXPECT_EQ(vector<int>(list.begin(), list.end()), (vector<int>{1, 0, 2, 0, 0}));
+    list.reverse();
+    EXPECT_EQ(vector<int>(list.begin(), list.end()), (vector<int>{0, 0, 2, 0, 1}));
+}
+
+TEST(index_list, erase_returns_next) {
+    XorIndexList<int> list = {0, 1, 2, 3};
+    auto it = list.erase(++list.begin());
+    EXPECT_EQ(*it, 2);
+    it = list.erase(it);
+    EXPECT_EQ(*it, 3);
+    it = list.erase(it);
+    EXPECT_TRUE(it == list.end());
+    EXPECT_EQ(vector<int>(list.begin(), list.end()), (vector<int>{0}));
+    EXPECT_FALSE(list.empty());
+    list.erase(list.begin());
+    EXPECT_TRUE(list.empty());
+}
+
+TEST(index_list, sort_unique) {
+    typedef std::pair<int, int> Pair;
+    XorIndexList<Pair> list;
+    for (int i = 0; i < 100; ++i) {
+        list.push_back(std::make_pair(i * 37 % 10, i));
+    }
+    vector<Pair> answer(list.begin(), list.end());
+    auto by_first = [](const Pair& a, const Pair& b) {
+        return a.first < b.first;
+    };
+    std::stable_sort(answer.begin(), answer.end(), by_first);
+    list.sort(by_first);
+    EXPECT_EQ(vector<Pair>(list.begin(), list.end()), answer);
+    EXPECT_EQ(list.back(), answer.back());
+    list.push_front(std::make_pair(-1, -1));
+    EXPECT_EQ(list.front().first, -1);
+
+    auto throwing = [](const Pair&, const Pair&) -> bool {
+        throw YException("comp");
+    };
+    answer.insert(answer.begin(), std::make_pair(-1, -1));
+    EXPECT_THROW(list.sort(throwing), YException);
+    EXPECT_EQ(vector<Pair>(list.begin(), list.end()), answer);
+
+    XorIndexList<int> ints = {3, 1, 3, 3, 2, 1, 1};
+    ints.sort();
+    ints.unique();
+    EXPECT_EQ(vector<int>(ints.begin(), ints.end()), (vector<int>{1, 2, 3}));
+    EXPECT_EQ(ints.size(), 3);
+    EXPECT_EQ(ints.back(), 3);
+}
+
+TEST(index_list, pop_front_n) {
+    XorIndexList<int> list = {0, 1, 2, 3, 4};
+    vector<int> out;
+    list.pop_front_n(2, std::back_inserter(out));
+    EXPECT_EQ(out, (vector<int>{0, 1}));
+    EXPECT_EQ(list.front(), 2);
+
+    list.drain_into(out);
+    EXPECT_EQ(out, (vector<int>{0, 1, 2, 3, 4}));
+    EXPECT_TRUE(list.empty());
+    list.push_back(7);
+    EXPECT_EQ(list.front(), 7);
+}
+
+TEST(index_list, copy_destroy) {
+    Checker::events.clear();
+    {
+        XorIndexList<Checker> list(3);
+        XorIndexList<Checker> copy(list);
+        copy.pop_front();
+        for (int i = 0; i < 100; ++i) {
+            copy.push_back(Checker());
+        }
+    }
+
+    EXPECT_EQ(std::count(Checker::events.begin(), Checker::events.end(), DESTRUCT),
+              std::count_if(Checker::events.begin(), Checker::events.end(),
+                            [](CheckerEvent e) { return e != DESTRUCT; }));
+}
+
+TEST(index_list, footprint) {
+    XorIndexList<int> list;
+    list.reserve(1000);
+    for (int i = 0; i < 1000; ++i) {
+        list.push_back(i);
+    }
+
+    EXPECT_EQ(sizeof(XorIndexNode<int>), 2 * sizeof(int));
+    EXPECT_LT(list.memory_footprint(), XorList<int>(1000).memory_footprint() / 2 + 100);
+}
+
+TEST(auto_tests, index_check_is_equial) {
+    size_t size = 20;
+    int count = 10000;
+    for (int i = 0; i < count; ++i) {
+        bool ok = check_is_equial<int,
+                std::list<int>,
+                XorIndexList<int, StackAllocator<int> > >(size);
+        EXPECT_TRUE(ok);
+    }
+}
+
+//------------------------------------------------------------------------
+
+namespace persistent_test {
+
+    std::string temp_path(const std::string& name) {
+        std::string path = testing::TempDir() + "xor_list_" + name;
+        std::remove(path.c_str());
+        std::remove((path + ".journal").c_str());
+        return path;
+    }
+
+    void remove_list(const std::string& path) {
+        std::remove(path.c_str());
+        std::remove((path + ".journal").c_str());
+    }
+
+    // Makes the changes in a child process that dies without syncing them.
+    template <class Change>
+    void crash_after(const std::string& path, Change change) {
+        run_isolated([&path, &change]() {
+            auto list = new PersistentXorList<int>(path);
+            change(*list);
+            return WorkloadResult();
+        });
+    }
+
+}
+
+TEST(persistent_list, reopen) {
+    std::string path = persistent_test::temp_path("reopen");
+    {
+        PersistentXorList<int> list(path);
+        for (int i = 0; i < 100000; ++i) {
+            list.push_back(i);
+        }
+        list.push_front(-1);
+        list.pop_back();
+    }
+
+    PersistentXorList<int> list(path, true);
+    EXPECT_TRUE(list.verify());
+    EXPECT_EQ(list.size(), 100000);
+    EXPECT_EQ(list.front(), -1);
+    EXPECT_EQ(list.back(), 99998);
+
+    auto it = list.begin();
+    ++it;
+    it = list.insert_after(it, 7);
+    list.erase(list.begin());
+    vector<int> answer = {0, 7, 1, 2};
+    EXPECT_EQ(vector<int>(list.begin(), std::next(list.begin(), 4)), answer);
+    list.sync();
+    EXPECT_TRUE(list.verify());
+    persistent_test::remove_list(path);
+}
+
+TEST(persistent_list, open_twice) {
+    std::string path = persistent_test::temp_path("open_twice");
+    PersistentXorList<int> list(path);
+    EXPECT_THROW(PersistentXorList<int> other(path), YException);
+    persistent_test::remove_list(path);
+}
+
+TEST(persistent_list, unsynced_changes) {
+    std::string path = persistent_test::temp_path("unsynced");
+    {
+        PersistentXorList<int> list(path);
+        for (int i = 0; i < 10000; ++i) {
+            list.push_back(i);
+        }
+    }
+
+    persistent_test::crash_after(path, [](PersistentXorList<int>& list) {
+        for (int i = 0; i < 5000; ++i) {
+            list.pop_front();
+        }
+        list.push_back(-1);
+        list.replace(list.begin(), -2);
+        list.sync();
+        list.clear();
+        for (int i = 0; i < 20000; ++i) {
+            list.push_front(i);
+        }
+    });
+
+    PersistentXorList<int> list(path, true);
+    EXPECT_EQ(list.size(), 5001);
+    EXPECT_EQ(list.front(), -2);
+    EXPECT_EQ(list.back(), -1);
+    vector<int> values(list.begin(), list.end());
+    for (int i = 1; i < 5000; ++i) {
+        EXPECT_EQ(values[i], 5000 + i);
+    }
+    persistent_test::remove_list(path);
+}
+
+TEST(persistent_list, corruption) {
+    std::string path = persistent_test::temp_path("corruption");
+    {
+        PersistentXorList<int> list(path);
+        list.push_back(1);
+    }
+    {
+        MappedFile file(path);
+        static_cast<char*>(file.data())[4096] ^= 1;
+    }
+
+    {
+        PersistentXorList<int> list(path);
+        EXPECT_FALSE(list.verify());
+    }
+    EXPECT_THROW(PersistentXorList<int> list(path, true), YException);
+    typedef std::array<char, 32> Record;
+    EXPECT_THROW(PersistentXorList<Record> other(path), YException);
+    {
+        MappedFile file(path);
+        static_cast<PersistentXorListHeader*>(file.data())->size++;
+    }
+    EXPECT_THROW(PersistentXorList<int> list(path), YException);
+    persistent_test::remove_list(path);
+}
+
+TEST(persistent_list, replace) {
+    std::string path = persistent_test::temp_path("replace");
+    {
+        PersistentXorList<int> list(path);
+        list.push_back(1);
+        list.push_back(2);
+        list.sync();
+
+        auto it = list.begin();
+        list.replace(it, 3);
+        EXPECT_EQ(*it, 3);
+        EXPECT_FALSE(list.verify());
+        list.replace(++it, 4);
+    }
+
+    PersistentXorList<int> list(path, true);
+    EXPECT_EQ(vector<int>(list.begin(), list.end()), (vector<int>{3, 4}));
+    persistent_test::remove_list(path);
+}
+
+//------------------------------------------------------------------------
+
+TEST(workload, profiles_agree) {
+    WorkloadConfig config;
+    config.operations = 20000;
+    config.list_size = 300;
+    for (int i = 0; i < COUNT_OF_WORKLOAD_PROFILES; ++i) {
+        config.profile = static_cast<WorkloadProfile>(i);
+        WorkloadProfile parsed;
+        EXPECT_TRUE(parse_profile(profile_name(config.profile), parsed));
+        EXPECT_EQ(parsed, config.profile);
+
+        auto expected = run_workload<std::list<int> >(config);
+        EXPECT_EQ(expected.operations, config.operations);
+        EXPECT_NE(expected.checksum, 0);
+        EXPECT_EQ(run_workload<XorList<int> >(config).checksum, expected.checksum);
+        EXPECT_EQ((run_workload<XorList<int, StackAllocator<int> > >(config).checksum), expected.checksum);
+        EXPECT_EQ(run_workload<std::deque<int> >(config).checksum, expected.checksum);
+    }
+}
+
+TEST(workload, isolated) {
+    WorkloadConfig config;
+    config.operations = 1000;
+    auto result = run_isolated([&config]() {
+        return run_workload<XorList<int> >(config);
+    });
+    EXPECT_EQ(result.checksum, run_workload<XorList<int> >(config).checksum);
+    EXPECT_GT(result.peak_rss_kb, 0);
+
+    EXPECT_THROW(run_isolated([]() -> WorkloadResult {
+        throw YException("failed");
+    }), YException);
+}
+
+//------------------------------------------------------------------------
+
+TEST(trace, index_encoding) {
+    unsigned char buffer[MAX_INDEX_SIZE];
+    for (uint64_t index : {0ULL, 127ULL, 128ULL, 300ULL, 1ULL << 35, ~0ULL}) {
+        size_t size = encode_index(index, buffer);
+        const unsigned char* data = buffer;
+        uint64_t decoded;
+        EXPECT_TRUE(decode_index(data, buffer + size, decoded));
+        EXPECT_EQ(decoded, index);
+        EXPECT_EQ(data, buffer + size);
+
+        data = buffer;
+        EXPECT_EQ(decode_index(data, buffer + size - 1, decoded), false);
+    }
+}
+
+TEST(trace, record_replay) {
+    std::string path = persistent_test::temp_path("trace");
+    XorList<int> list;
+    {
+        TraceRecorder<int> recorder(list, path);
+        for (int i = 0; i < 100; ++i) {
+            recorder.push_back(i);
+        }
+        recorder.push_front(-1);
+        recorder.insert_at(50, 1000);
+        recorder.erase_at(10);
+        EXPECT_EQ(recorder.at(49), 1000);
+        EXPECT_EQ(recorder.back(), 99);
+        recorder.pop_back();
+        recorder.pop_front();
+        long long sum = 0;
+        recorder.for_each([&sum](int value) { sum += value; });
+        EXPECT_EQ(sum, 99 * 98 / 2 - 9 + 1000);
+        EXPECT_EQ(recorder.size(), 99);
+        EXPECT_EQ(recorder.writer().count(), 109);
+    }
+
+    TraceReader<int> reader(path);
+    EXPECT_EQ(reader.size(), 109);
+    EXPECT_EQ((verify_trace<int, XorList<int> >(reader)), -1);
+    auto expected = replay_trace<int, std::list<int> >(reader);
+    EXPECT_EQ(expected.operations, 109);
+    EXPECT_EQ((replay_trace<int, XorList<int, StackAllocator<int> > >(reader).digest), expected.digest);
+    EXPECT_EQ((replay_trace<int, std::deque<int> >(reader).digest), expected.digest);
+
+    QueryInput<int> query;
+    reader.rewind();
+    EXPECT_TRUE(reader.next(query));
+    EXPECT_EQ(query.type, PUSH_BACK);
+    EXPECT_EQ(query.add.value, 0);
+    EXPECT_THROW(TraceReader<long long> other(path), YException);
+    std::remove(path.c_str());
+}
+
+TEST(trace, generated_queries) {
+    std::string path = persistent_test::temp_path("generated");
+    auto queries = gen_queries<int>(2000);
+    {
+        TraceWriter<int> writer(path);
+        for (const auto& query : queries) {
+            writer.write(query);
+        }
+    }
+
+    TraceReader<int> reader(path);
+    EXPECT_EQ((verify_trace<int, XorList<int> >(reader)), -1);
+    auto answers = get_answers<int, std::list<int> >(queries);
+    uint64_t digest = hash_bytes(nullptr, 0);
+    for (const auto& answer : answers) {
+        digest = output_digest(answer, digest);
+    }
+    EXPECT_EQ((replay_trace<int, XorList<int> >(reader).digest), digest);
+    std::remove(path.c_str());
+}
+
+TEST(trace, invalid) {
+    std::string path = persistent_test::temp_path("invalid");
+    EXPECT_THROW(TraceReader<int> reader(path), YException);
+    {
+        TraceWriter<int> writer(path);
+        QueryInput<int> query;
+        query.type = POP_BACK;
+        writer.write(query);
+    }
+    TraceReader<int> reader(path);
+    EXPECT_THROW((verify_trace<int, XorList<int> >(reader)), YException);
+
+    // A trace cut inside a record is read up to the record before it.
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        TraceHeader header = make_trace_header(sizeof(int));
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.put((char)PUSH_BACK);
+        int value = 7;
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+        out.put((char)INSERT_AT);
+        out.put((char)0x81);
     }
+    TraceReader<int> cut(path);
+    EXPECT_EQ(cut.size(), 0);
+    EXPECT_EQ((replay_trace<int, XorList<int> >(cut).operations), 1);
+    std::remove(path.c_str());
 }
@@ -0,0 +1,779 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "smallfunctions.h"
+
+template <typename T, class Alloc>
+class XorIndexListIterator;
+
+// Link is the XOR of the previous and the next slot index; slot 0 is never
+// used, so index 0 stands for nullptr. Free slots keep the next free index.
+template <typename T>
+struct XorIndexNode {
+public:
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    uint32_t link;
+
+    T& value() {
+        return *reinterpret_cast<T*>(&storage);
+    }
+};
+
+// Same interface as XorList, but all nodes live in one buffer and link by
+// 32-bit slot indices. Links don't depend on the buffer address, so the
+// buffer grows by relocating it, with one memcpy for trivially copyable T.
+// Iterators keep indices and stay valid across growth.
+//
+// There is no splice, append or merge: they take nodes from another list
+// without moving values, but nodes can't leave the buffer they live in.
+// Insert the other list's elements through move iterators instead.
+template <typename T, class Alloc = std::allocator<T> >
+class XorIndexList {
+public:
+    explicit XorIndexList(const Alloc& alloc = Alloc());
+    explicit XorIndexList(size_t count, const T& value = T(), const Alloc& alloc = Alloc());
+    template <class ForwardIt, class = typename std::enable_if<
+            not std::is_integral<ForwardIt>::value>::type>
+    XorIndexList(ForwardIt first, ForwardIt last, const Alloc& alloc = Alloc());
+    XorIndexList(std::initializer_list<T>, const Alloc& alloc = Alloc());
+
+    XorIndexList(const XorIndexList<T, Alloc>&);
+    XorIndexList(XorIndexList<T, Alloc>&&) noexcept;
+    ~XorIndexList();
+
+    XorIndexList<T, Alloc>& operator=(const XorIndexList<T, Alloc>&);
+    // Moves elements one by one, which may throw, if the allocator doesn't
+    // propagate and isn't equal to the one of other.
+    XorIndexList<T, Alloc>& operator=(XorIndexList<T, Alloc>&&)
+            noexcept(std::allocator_traits<AllocNode>::propagate_on_container_move_assignment::value);
+
+    friend class XorIndexListIterator<T, Alloc>;
+    typedef XorIndexListIterator<T, Alloc> iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+
+    size_t size() const;
+    bool empty() const;
+    size_t capacity() const;
+    // Bytes taken by the list object and its whole buffer.
+    size_t memory_footprint() const;
+    Alloc get_allocator() const;
+    void swap(XorIndexList<T, Alloc>&) noexcept;
+    void reserve(size_t count);
+
+    T& back();
+    T& front();
+
+    template <typename U> void push_back(U&&);
+    template <typename U> void push_front(U&&);
+    template <typename U> iterator insert_before(iterator, U&&);
+    template <typename U> iterator insert_after(iterator, U&&);
+
+    template <class ForwardIt> iterator insert(iterator, ForwardIt, ForwardIt);
+    template <class ForwardIt> void assign(ForwardIt, ForwardIt);
+    void assign(std::initializer_list<T>);
+
+    void pop_back();
+    void pop_front();
+    // Returns the iterator to the element after the erased one.
+    iterator erase(iterator);
+    // Keeps the buffer; new elements fill it from the start again.
+    void clear();
+    void reverse();
+
+    // Move up to n front elements to out.
+    template <class OutputIt> OutputIt pop_front_n(size_t n, OutputIt out);
+    void drain_into(std::vector<T>&);
+
+    // Stable sort relinks slots and never constructs or moves T. If comp
+    // throws, the list is left as it was.
+    void sort();
+    template <class Compare> void sort(Compare);
+    void unique();
+
+    iterator begin();
+    iterator end();
+
+private:
+    typedef XorIndexNode<T> node;
+    typedef uint32_t index_type;
+
+    static constexpr size_t _MIN_CAPACITY = 16;
+    static constexpr size_t _MAX_CAPACITY = (size_t)UINT32_MAX + 1;
+
+    node& slot(index_type index);
+    index_type take_slot();
+    void free_slot(index_type index);
+    void grow(size_t min_capacity);
+    void destroy_values();
+    void release_buffer();
+    iterator make_iterator(index_type prev, index_type cur);
+
+    typedef typename Alloc::template rebind<node>::other AllocNode;
+    AllocNode _alloc;
+    node* _slots;
+    size_t _capacity;
+    // Slots below _used have been taken at least once; slot 0 counts too.
+    size_t _used;
+    index_type _free;
+    index_type _first;
+    index_type _last;
+    size_t _size;
+#if DEBUG
+    uint _version;
+#endif
+};
+
+template <typename T, class Alloc>
+class XorIndexListIterator : public std::iterator<std::bidirectional_iterator_tag, T> {
+public:
+    friend class XorIndexList<T, Alloc>;
+
+    XorIndexListIterator<T, Alloc>& operator++();
+    const XorIndexListIterator<T, Alloc> operator++(int);
+    XorIndexListIterator<T, Alloc>& operator--();
+    const XorIndexListIterator<T, Alloc> operator--(int);
+    T& operator*();
+    T* operator->();
+
+    bool operator==(const XorIndexListIterator<T, Alloc>&) const;
+    bool operator!=(const XorIndexListIterator<T, Alloc>&) const;
+
+private:
+    XorIndexList<T, Alloc>* _list;
+    uint32_t _node;
+    uint32_t _prev_node;
+#if DEBUG
+    bool is_valid() const;
+    uint _version;
+#endif
+};
+
+//=======================================================================================
+//=======================================================================================
+
+template <typename T, class Alloc>
+constexpr size_t XorIndexList<T, Alloc>::_MIN_CAPACITY;
+
+template <typename T, class Alloc>
+constexpr size_t XorIndexList<T, Alloc>::_MAX_CAPACITY;
+
+template <typename T, class Alloc>
+XorIndexList<T, Alloc>::XorIndexList(const Alloc& alloc):
+        _alloc(alloc),
+        _slots(nullptr),
+        _capacity(0), _used(1),
+        _free(0), _first(0), _last(0),
+        _size(0) {
+#if DEBUG
+    _version = 0;
+#endif
+}
+
+template <typename T, class Alloc>
+XorIndexList<T, Alloc>::XorIndexList(size_t count, const T& value,
+                                     const Alloc& alloc): XorIndexList(alloc) {
+    reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        push_back(value);
+    }
+}
+
+template <typename T, class Alloc>
+template <class ForwardIt, class>
+XorIndexList<T, Alloc>::XorIndexList(ForwardIt first, ForwardIt last,
+                                     const Alloc& alloc): XorIndexList(alloc) {
+    insert(end(), first, last);
+}
+
+template <typename T, class Alloc>
+XorIndexList<T, Alloc>::XorIndexList(std::initializer_list<T> values,
+                                     const Alloc& alloc): XorIndexList(alloc) {
+    insert(end(), values.begin(), values.end());
+}
+
+// The copy is compacted: elements take slots 1..size in list order.
+template <typename T, class Alloc>
+XorIndexList<T, Alloc>::XorIndexList(const XorIndexList<T, Alloc>& other):
+        XorIndexList(Alloc(other._alloc)) {
+    auto other_ptr = const_cast<XorIndexList<T, Alloc>*>(&other);
+    insert(end(), other_ptr->begin(), other_ptr->end());
+}
+
+template <typename T, class Alloc>
+XorIndexList<T, Alloc>::XorIndexList(XorIndexList<T, Alloc>&& other) noexcept:
+        _alloc(other._alloc),
+        _slots(other._slots),
+        _capacity(other._capacity), _used(other._used),
+        _free(other._free), _first(other._first), _last(other._last),
+        _size(other._size) {
+#if DEBUG
+    _version = 0;
+#endif
+    other._slots = nullptr;
+    other._capacity = 0;
+    other._used = 1;
+    other._free = other._first = other._last = 0;
+    other._size = 0;
+}
+
+template <typename T, class Alloc>
+XorIndexList<T, Alloc>::~XorIndexList() {
+    destroy_values();
+    release_buffer();
+}
+
+template <typename T, class Alloc>
+XorIndexList<T, Alloc>& XorIndexList<T, Alloc>::operator=(const XorIndexList<T, Alloc>& other) {
+    if (this == &other) {
+        return *this;
+    }
+    clear();
+    if (std::allocator_traits<AllocNode>::propagate_on_container_copy_assignment::value) {
+        release_buffer();
+        _alloc = other._alloc;
+    }
+    auto other_ptr = const_cast<XorIndexList<T, Alloc>*>(&other);
+    insert(end(), other_ptr->begin(), other_ptr->end());
+    return *this;
+}
+
+template <typename T, class Alloc>
+XorIndexList<T, Alloc>& XorIndexList<T, Alloc>::operator=(XorIndexList<T, Alloc>&& other)
+        noexcept(std::allocator_traits<AllocNode>::propagate_on_container_move_assignment::value) {
+    if (this == &other) {
+        return *this;
+    }
+    clear();
+
+    if (not std::allocator_traits<AllocNode>::propagate_on_container_move_assignment::value
+            and not (_alloc == other._alloc)) {
+        // Buffer of other list can't be freed by our allocator
+        for (auto it = other.begin(); it != other.end(); ++it) {
+            push_back(std::move(*it));
+        }
+        return *this;
+    }
+
+    release_buffer();
+    _alloc = other._alloc;
+    _slots = other._slots;
+    _capacity = other._capacity;
+    _used = other._used;
+    _free = other._free;
+    _first = other._first;
+    _last = other._last;
+    _size = other._size;
+
+    other._slots = nullptr;
+    other._capacity = 0;
+    other._used = 1;
+    other._free = other._first = other._last = 0;
+    other._size = 0;
+    return *this;
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::swap(XorIndexList<T, Alloc>& other) noexcept {
+    if (std::allocator_traits<AllocNode>::propagate_on_container_swap::value) {
+        std::swap(_alloc, other._alloc);
+    }
+    std::swap(_slots, other._slots);
+    std::swap(_capacity, other._capacity);
+    std::swap(_used, other._used);
+    std::swap(_free, other._free);
+    std::swap(_first, other._first);
+    std::swap(_last, other._last);
+    std::swap(_size, other._size);
+#if DEBUG
+    _version++;
+    other._version++;
+#endif
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, class Alloc>
+typename XorIndexList<T, Alloc>::node& XorIndexList<T, Alloc>::slot(index_type index) {
+    return _slots[index];
+}
+
+template <typename T, class Alloc>
+typename XorIndexList<T, Alloc>::index_type XorIndexList<T, Alloc>::take_slot() {
+    if (_free != 0) {
+        index_type result = _free;
+        _free = slot(result).link;
+        return result;
+    }
+    if (_used >= _capacity) {
+        grow(_capacity + 1);
+    }
+    return (index_type)_used++;
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::free_slot(index_type index) {
+    slot(index).link = _free;
+    _free = index;
+}
+
+// Slot indices are kept, so live values are moved to the same slots of the
+// new buffer and free slots keep their links.
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::grow(size_t min_capacity) {
+    if (min_capacity > _MAX_CAPACITY)
+        throw YException("XorIndexList: too many elements for 32-bit links");
+
+    size_t new_capacity = std::max(min_capacity, std::max(_MIN_CAPACITY, 2 * _capacity));
+    new_capacity = std::min(new_capacity, _MAX_CAPACITY);
+    node* new_slots = _alloc.allocate(new_capacity);
+
+    if (_slots != nullptr) {
+        if (std::is_trivially_copyable<T>::value) {
+            memcpy(new_slots, _slots, _used * sizeof(node));
+        }
+        else {
+            for (size_t i = 1; i < _used; ++i) {
+                new_slots[i].link = _slots[i].link;
+            }
+            index_type prev = 0;
+            index_type cur = _first;
+            while (cur != 0) {
+                _alloc.construct(&new_slots[cur].value(), std::move(slot(cur).value()));
+                _alloc.destroy(&slot(cur).value());
+                index_type next = prev ^ slot(cur).link;
+                prev = cur;
+                cur = next;
+            }
+        }
+        _alloc.deallocate(_slots, _capacity);
+    }
+
+    _slots = new_slots;
+    _capacity = new_capacity;
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::reserve(size_t count) {
+    if (count + 1 > _capacity) {
+        grow(count + 1);
+    }
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::destroy_values() {
+    if (std::is_trivially_destructible<T>::value) {
+        return;
+    }
+
+    index_type prev = 0;
+    index_type cur = _first;
+    while (cur != 0) {
+        index_type next = prev ^ slot(cur).link;
+        _alloc.destroy(&slot(cur).value());
+        prev = cur;
+        cur = next;
+    }
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::release_buffer() {
+    if (_slots != nullptr) {
+        _alloc.deallocate(_slots, _capacity);
+    }
+    _slots = nullptr;
+    _capacity = 0;
+    _used = 1;
+    _free = 0;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, class Alloc>
+typename XorIndexList<T, Alloc>::iterator XorIndexList<T, Alloc>::make_iterator
+        (index_type prev, index_type cur) {
+    iterator iter;
+    iter._list = this;
+    iter._node = cur;
+    iter._prev_node = prev;
+#if DEBUG
+    iter._version = _version;
+#endif
+    return iter;
+}
+
+template <typename T, class Alloc>
+typename XorIndexList<T, Alloc>::iterator XorIndexList<T, Alloc>::begin() {
+    return make_iterator(0, _first);
+}
+
+template <typename T, class Alloc>
+typename XorIndexList<T, Alloc>::iterator XorIndexList<T, Alloc>::end() {
+    return make_iterator(_last, 0);
+}
+
+template <typename T, class Alloc>
+size_t XorIndexList<T, Alloc>::size() const {
+    return _size;
+}
+
+template <typename T, class Alloc>
+bool XorIndexList<T, Alloc>::empty() const {
+    return _size == 0;
+}
+
+template <typename T, class Alloc>
+size_t XorIndexList<T, Alloc>::capacity() const {
+    return _capacity == 0 ? 0 : _capacity - 1;
+}
+
+template <typename T, class Alloc>
+size_t XorIndexList<T, Alloc>::memory_footprint() const {
+    return sizeof(*this) + _capacity * sizeof(node);
+}
+
+template <typename T, class Alloc>
+Alloc XorIndexList<T, Alloc>::get_allocator() const {
+    return Alloc(_alloc);
+}
+
+template <typename T, class Alloc>
+T& XorIndexList<T, Alloc>::back() {
+    if (_size == 0)
+        throw YException("XorIndexList: trying to get elements from empty list");
+
+    return slot(_last).value();
+}
+
+template <typename T, class Alloc>
+T& XorIndexList<T, Alloc>::front() {
+    if (_size == 0)
+        throw YException("XorIndexList: trying to get elements from empty list");
+
+    return slot(_first).value();
+}
+
+//---------------------------------------------------------------------------
+
+template <typename T, class Alloc>
+template <typename U>
+typename XorIndexList<T, Alloc>::iterator XorIndexList<T, Alloc>::insert_before
+        (iterator iter, U&& value) {
+#ifdef DEBUG
+    if (iter._version != this->_version)
+        throw YException("XorIndexList: Iterator is invalid because the list has been changed");
+    if (iter._list != this)
+        throw YException("XorIndexList: trying to use iterator from other list");
+#endif
+
+    // value may refer into the buffer, so take it out before the buffer moves.
+    if (_free == 0 and _used >= _capacity) {
+        T copy(std::forward<U>(value));
+        grow(_capacity + 1);
+        return insert_before(iter, std::move(copy));
+    }
+
+    index_type added = take_slot();
+    try {
+        _alloc.construct(&slot(added).value(), std::forward<U>(value));
+    }
+    catch (...) {
+        free_slot(added);
+        throw;
+    }
+    slot(added).link = iter._prev_node ^ iter._node;
+
+    if (iter._node != 0) {
+        slot(iter._node).link ^= added ^ iter._prev_node;
+    }
+    else {
+        _last = added;
+    }
+
+    if (iter._prev_node != 0) {
+        slot(iter._prev_node).link ^= added ^ iter._node;
+    }
+    else {
+        _first = added;
+    }
+    iter._prev_node = added;
+
+    _size++;
+#if DEBUG
+    _version++;
+    iter._version++;
+#endif
+    return iter;
+}
+
+template <typename T, class Alloc>
+template <typename U>
+typename XorIndexList<T, Alloc>::iterator XorIndexList<T, Alloc>::insert_after
+        (iterator iter, U&& value) {
+#ifdef DEBUG
+    if (iter == end())
+        throw YException("XorIndexList: trying to insert after end iterator");
+#endif
+
+    ++iter;
+    iter = insert_before(iter, std::forward<U>(value));
+    --iter;
+    --iter;
+    return iter;
+}
+
+template <typename T, class Alloc>
+template <typename U>
+void XorIndexList<T, Alloc>::push_back(U&& value) {
+    insert_before(end(), std::forward<U>(value));
+}
+
+template <typename T, class Alloc>
+template <typename U>
+void XorIndexList<T, Alloc>::push_front(U&& value) {
+    insert_before(begin(), std::forward<U>(value));
+}
+
+template <typename T, class Alloc>
+template <class ForwardIt>
+typename XorIndexList<T, Alloc>::iterator XorIndexList<T, Alloc>::insert
+        (iterator pos, ForwardIt first, ForwardIt last) {
+    reserve(_size + (size_t)std::distance(first, last));
+    for (; first != last; ++first) {
+        pos = insert_before(pos, *first);
+    }
+    return pos;
+}
+
+template <typename T, class Alloc>
+template <class ForwardIt>
+void XorIndexList<T, Alloc>::assign(ForwardIt first, ForwardIt last) {
+    clear();
+    insert(end(), first, last);
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::assign(std::initializer_list<T> values) {
+    assign(values.begin(), values.end());
+}
+
+//---------------------------------------------------------------------------
+
+template <typename T, class Alloc>
+typename XorIndexList<T, Alloc>::iterator XorIndexList<T, Alloc>::erase(iterator iter) {
+#ifdef DEBUG
+    if (iter._node == 0)
+        throw YException("XorIndexList: trying to erase element after last");
+    if (iter._version != this->_version)
+        throw YException("XorIndexList: Iterator is invalid because the list has been changed");
+    if (iter._list != this)
+        throw YException("XorIndexList: trying to use iterator from other list");
+#endif
+
+    index_type next_node = iter._prev_node ^ slot(iter._node).link;
+
+    if (next_node != 0) {
+        slot(next_node).link ^= iter._node ^ iter._prev_node;
+    }
+    else {
+        _last = iter._prev_node;
+    }
+
+    if (iter._prev_node != 0) {
+        slot(iter._prev_node).link ^= iter._node ^ next_node;
+    }
+    else {
+        _first = next_node;
+    }
+
+    _alloc.destroy(&slot(iter._node).value());
+    free_slot(iter._node);
+
+    --_size;
+#if DEBUG
+    ++_version;
+#endif
+    return make_iterator(iter._prev_node, next_node);
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::pop_back() {
+    auto it = end();
+    --it;
+    erase(it);
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::pop_front() {
+    erase(begin());
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::clear() {
+    destroy_values();
+    _used = 1;
+    _free = _first = _last = 0;
+    _size = 0;
+#if DEBUG
+    _version++;
+#endif
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::reverse() {
+    std::swap(_first, _last);
+#if DEBUG
+    _version++;
+#endif
+}
+
+template <typename T, class Alloc>
+template <class OutputIt>
+OutputIt XorIndexList<T, Alloc>::pop_front_n(size_t n, OutputIt out) {
+    n = std::min(n, _size);
+    for (size_t i = 0; i < n; ++i) {
+        *out = std::move(front());
+        ++out;
+        pop_front();
+    }
+    return out;
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::drain_into(std::vector<T>& out) {
+    out.reserve(out.size() + _size);
+    pop_front_n(_size, std::back_inserter(out));
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::sort() {
+    sort(std::less<T>());
+}
+
+// Slot indices are sorted aside, so links change only once comp is done.
+template <typename T, class Alloc>
+template <class Compare>
+void XorIndexList<T, Alloc>::sort(Compare comp) {
+    std::vector<index_type> order;
+    order.reserve(_size);
+    for (auto it = begin(); it != end(); ++it) {
+        order.push_back(it._node);
+    }
+    std::stable_sort(order.begin(), order.end(), [this, &comp](index_type a, index_type b) {
+        return comp(slot(a).value(), slot(b).value());
+    });
+
+    index_type prev = 0;
+    for (size_t i = 0; i < order.size(); ++i) {
+        index_type next = i + 1 < order.size() ? order[i + 1] : 0;
+        slot(order[i]).link = prev ^ next;
+        prev = order[i];
+    }
+    if (not order.empty()) {
+        _first = order.front();
+        _last = order.back();
+    }
+#if DEBUG
+    _version++;
+#endif
+}
+
+template <typename T, class Alloc>
+void XorIndexList<T, Alloc>::unique() {
+    if (_size == 0) {
+        return;
+    }
+
+    auto cur = begin();
+    auto next = cur;
+    ++next;
+    while (next != end()) {
+        if (*next == *cur) {
+            next = erase(next);
+            cur = next;
+            --cur;
+        }
+        else {
+            cur = next;
+            ++next;
+        }
+    }
+}
+
+//**********************************************************************************
+
+template <typename T, class Alloc>
+XorIndexListIterator<T, Alloc>& XorIndexListIterator<T, Alloc>::operator++() {
+#if DEBUG
+    if (!is_valid())
+        throw YException("XorIndexList iterator: Iterator is invalid because the list has been changed");
+#endif
+
+    auto next_node = _prev_node ^ _list->slot(_node).link;
+    _prev_node = _node;
+    _node = next_node;
+    return *this;
+}
+
+template <typename T, class Alloc>
+XorIndexListIterator<T, Alloc>& XorIndexListIterator<T, Alloc>::operator--() {
+#if DEBUG
+    if (!is_valid())
+        throw YException("XorIndexList iterator: Iterator is invalid because the list has been changed");
+#endif
+
+    auto very_prev_node = _node ^ _list->slot(_prev_node).link;
+    _node = _prev_node;
+    _prev_node = very_prev_node;
+    return *this;
+}
+
+template <typename T, class Alloc>
+const XorIndexListIterator<T, Alloc> XorIndexListIterator<T, Alloc>::operator++(int) {
+    auto result = *this;
+    operator++();
+    return result;
+}
+
+template <typename T, class Alloc>
+const XorIndexListIterator<T, Alloc> XorIndexListIterator<T, Alloc>::operator--(int) {
+    auto result = *this;
+    operator--();
+    return result;
+}
+
+//----------------------------------------------------------------------------------
+
+template <typename T, class Alloc>
+bool XorIndexListIterator<T, Alloc>::operator==
+        (const XorIndexListIterator<T, Alloc>& other) const {
+    return _list == other._list and _node == other._node;
+}
+
+template <typename T, class Alloc>
+bool XorIndexListIterator<T, Alloc>::operator!=(const XorIndexListIterator<T, Alloc>& other) const {
+    return not (*this == other);
+}
+
+template <typename T, class Alloc>
+T& XorIndexListIterator<T, Alloc>::operator*() {
+    return _list->slot(_node).value();
+}
+
+template <typename T, class Alloc>
+T* XorIndexListIterator<T, Alloc>::operator->() {
+    return &_list->slot(_node).value();
+}
+
+#if DEBUG
+template <typename T, class Alloc>
+bool XorIndexListIterator<T, Alloc>::is_valid() const {
+    return _version == _list->_version;
+}
+#endif
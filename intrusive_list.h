@@ -0,0 +1,395 @@
+#pragma once
+#include <iterator>
+#include <type_traits>
+#include "smallfunctions.h"
+
+// Link embedded in objects of IntrusiveXorList. An object may be in as many
+// lists at once as it has hooks.
+struct XorListHook {
+    XorListHook* ptr;
+
+    XorListHook(): ptr(nullptr) {}
+};
+
+template <typename T, XorListHook T::*Hook>
+class IntrusiveXorListIterator;
+
+// XorList over objects the user owns: the list links their Hook members and
+// never allocates, copies or destroys them. Objects must stay in place while
+// linked, and a destroyed list leaves its objects unlinked but untouched.
+template <typename T, XorListHook T::*Hook>
+class IntrusiveXorList {
+public:
+    IntrusiveXorList();
+    IntrusiveXorList(IntrusiveXorList<T, Hook>&&) noexcept;
+    ~IntrusiveXorList() = default;
+
+    IntrusiveXorList(const IntrusiveXorList<T, Hook>&) = delete;
+    IntrusiveXorList<T, Hook>& operator=(const IntrusiveXorList<T, Hook>&) = delete;
+    IntrusiveXorList<T, Hook>& operator=(IntrusiveXorList<T, Hook>&&) noexcept;
+
+    friend class IntrusiveXorListIterator<T, Hook>;
+    typedef IntrusiveXorListIterator<T, Hook> iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+
+    size_t size() const;
+    bool empty() const;
+
+    T& back();
+    T& front();
+
+    void push_back(T&);
+    void push_front(T&);
+    iterator insert_before(iterator, T&);
+    iterator insert_after(iterator, T&);
+
+    void pop_back();
+    void pop_front();
+    // Returns the iterator to the element after the erased one.
+    iterator erase(iterator);
+    void clear();
+
+    iterator begin();
+    iterator end();
+
+private:
+    typedef XorListHook hook;
+
+    static hook* to_hook(T& object);
+    static T& to_object(hook* link);
+    iterator make_iterator(hook* prev, hook* cur);
+
+    hook* _first;
+    hook* _last;
+    size_t _size;
+#if DEBUG
+    uint _version;
+#endif
+};
+
+template <typename T, XorListHook T::*Hook>
+class IntrusiveXorListIterator : public std::iterator<std::bidirectional_iterator_tag, T> {
+public:
+    friend class IntrusiveXorList<T, Hook>;
+
+    IntrusiveXorListIterator<T, Hook>& operator++();
+    const IntrusiveXorListIterator<T, Hook> operator++(int);
+    IntrusiveXorListIterator<T, Hook>& operator--();
+    const IntrusiveXorListIterator<T, Hook> operator--(int);
+    T& operator*();
+    T* operator->();
+
+    bool operator==(const IntrusiveXorListIterator<T, Hook>&) const;
+    bool operator!=(const IntrusiveXorListIterator<T, Hook>&) const;
+
+private:
+    IntrusiveXorList<T, Hook>* _list;
+    XorListHook* _node;
+    XorListHook* _prev_node;
+#if DEBUG
+    bool is_valid() const;
+    uint _version;
+#endif
+};
+
+//=======================================================================================
+//=======================================================================================
+
+template <typename T, XorListHook T::*Hook>
+IntrusiveXorList<T, Hook>::IntrusiveXorList():
+        _first(nullptr), _last(nullptr),
+        _size(0) {
+#if DEBUG
+    _version = 0;
+#endif
+}
+
+template <typename T, XorListHook T::*Hook>
+IntrusiveXorList<T, Hook>::IntrusiveXorList(IntrusiveXorList<T, Hook>&& other) noexcept:
+        _first(other._first), _last(other._last),
+        _size(other._size) {
+#if DEBUG
+    _version = 0;
+#endif
+    other._first = other._last = nullptr;
+    other._size = 0;
+}
+
+template <typename T, XorListHook T::*Hook>
+IntrusiveXorList<T, Hook>& IntrusiveXorList<T, Hook>::operator=
+        (IntrusiveXorList<T, Hook>&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+    _first = other._first;
+    _last = other._last;
+    _size = other._size;
+#if DEBUG
+    _version++;
+#endif
+
+    other._size = 0;
+    other._first = other._last = nullptr;
+    return *this;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, XorListHook T::*Hook>
+typename IntrusiveXorList<T, Hook>::hook* IntrusiveXorList<T, Hook>::to_hook(T& object) {
+    return &(object.*Hook);
+}
+
+// Offset of the hook is taken from a placeholder, no T is constructed.
+template <typename T, XorListHook T::*Hook>
+T& IntrusiveXorList<T, Hook>::to_object(hook* link) {
+    static const typename std::aligned_storage<sizeof(T), alignof(T)>::type placeholder = {};
+    auto base = reinterpret_cast<const T*>(&placeholder);
+    auto offset = reinterpret_cast<const char*>(&(base->*Hook)) - reinterpret_cast<const char*>(base);
+    return *reinterpret_cast<T*>(reinterpret_cast<char*>(link) - offset);
+}
+
+template <typename T, XorListHook T::*Hook>
+typename IntrusiveXorList<T, Hook>::iterator IntrusiveXorList<T, Hook>::make_iterator
+        (hook* prev, hook* cur) {
+    iterator iter;
+    iter._list = this;
+    iter._node = cur;
+    iter._prev_node = prev;
+#if DEBUG
+    iter._version = _version;
+#endif
+    return iter;
+}
+
+template <typename T, XorListHook T::*Hook>
+typename IntrusiveXorList<T, Hook>::iterator IntrusiveXorList<T, Hook>::begin() {
+    return make_iterator(nullptr, _first);
+}
+
+template <typename T, XorListHook T::*Hook>
+typename IntrusiveXorList<T, Hook>::iterator IntrusiveXorList<T, Hook>::end() {
+    return make_iterator(_last, nullptr);
+}
+
+template <typename T, XorListHook T::*Hook>
+size_t IntrusiveXorList<T, Hook>::size() const {
+    return _size;
+}
+
+template <typename T, XorListHook T::*Hook>
+bool IntrusiveXorList<T, Hook>::empty() const {
+    return _size == 0;
+}
+
+template <typename T, XorListHook T::*Hook>
+T& IntrusiveXorList<T, Hook>::back() {
+    if (_size == 0)
+        throw YException("IntrusiveXorList: trying to get elements from empty list");
+
+    return to_object(_last);
+}
+
+template <typename T, XorListHook T::*Hook>
+T& IntrusiveXorList<T, Hook>::front() {
+    if (_size == 0)
+        throw YException("IntrusiveXorList: trying to get elements from empty list");
+
+    return to_object(_first);
+}
+
+//---------------------------------------------------------------------------
+
+// Returned iterator points to the same element as iter.
+template <typename T, XorListHook T::*Hook>
+typename IntrusiveXorList<T, Hook>::iterator IntrusiveXorList<T, Hook>::insert_before
+        (iterator iter, T& object) {
+#ifdef DEBUG
+    if (iter._version != this->_version)
+        throw YException("IntrusiveXorList: Iterator is invalid because the list has been changed");
+    if (iter._list != this)
+        throw YException("IntrusiveXorList: trying to use iterator from other list");
+#endif
+
+    hook* added = to_hook(object);
+    added->ptr = xor_ptr(iter._prev_node, iter._node);
+
+    if (iter._node != nullptr) {
+        iter._node->ptr = xor_ptr(iter._node->ptr, added, iter._prev_node);
+    }
+    else {
+        _last = added;
+    }
+
+    if (iter._prev_node != nullptr) {
+        iter._prev_node->ptr = xor_ptr(iter._prev_node->ptr, added, iter._node);
+    }
+    else {
+        _first = added;
+    }
+    iter._prev_node = added;
+
+    _size++;
+#if DEBUG
+    _version++;
+    iter._version++;
+#endif
+    return iter;
+}
+
+template <typename T, XorListHook T::*Hook>
+typename IntrusiveXorList<T, Hook>::iterator IntrusiveXorList<T, Hook>::insert_after
+        (iterator iter, T& object) {
+#ifdef DEBUG
+    if (iter == end())
+        throw YException("IntrusiveXorList: trying to insert after end iterator");
+#endif
+
+    ++iter;
+    iter = insert_before(iter, object);
+    --iter;
+    --iter;
+    return iter;
+}
+
+template <typename T, XorListHook T::*Hook>
+void IntrusiveXorList<T, Hook>::push_back(T& object) {
+    insert_before(end(), object);
+}
+
+template <typename T, XorListHook T::*Hook>
+void IntrusiveXorList<T, Hook>::push_front(T& object) {
+    insert_before(begin(), object);
+}
+
+//---------------------------------------------------------------------------
+
+template <typename T, XorListHook T::*Hook>
+typename IntrusiveXorList<T, Hook>::iterator IntrusiveXorList<T, Hook>::erase(iterator iter) {
+#ifdef DEBUG
+    if (iter._node == nullptr)
+        throw YException("IntrusiveXorList: trying to erase element after last");
+    if (iter._version != this->_version)
+        throw YException("IntrusiveXorList: Iterator is invalid because the list has been changed");
+    if (iter._list != this)
+        throw YException("IntrusiveXorList: trying to use iterator from other list");
+#endif
+
+    hook* next_node = xor_ptr(iter._prev_node, iter._node->ptr);
+
+    if (next_node != nullptr) {
+        next_node->ptr = xor_ptr(next_node->ptr, iter._node, iter._prev_node);
+    }
+    else {
+        _last = iter._prev_node;
+    }
+
+    if (iter._prev_node != nullptr) {
+        iter._prev_node->ptr = xor_ptr(iter._prev_node->ptr, iter._node, next_node);
+    }
+    else {
+        _first = next_node;
+    }
+    iter._node->ptr = nullptr;
+
+    --_size;
+#if DEBUG
+    ++_version;
+#endif
+    return make_iterator(iter._prev_node, next_node);
+}
+
+template <typename T, XorListHook T::*Hook>
+void IntrusiveXorList<T, Hook>::pop_back() {
+    auto it = end();
+    --it;
+    erase(it);
+}
+
+template <typename T, XorListHook T::*Hook>
+void IntrusiveXorList<T, Hook>::pop_front() {
+    erase(begin());
+}
+
+// Objects keep their stale links; they are rewritten on the next insert.
+template <typename T, XorListHook T::*Hook>
+void IntrusiveXorList<T, Hook>::clear() {
+    _first = _last = nullptr;
+    _size = 0;
+#if DEBUG
+    _version++;
+#endif
+}
+
+//**********************************************************************************
+
+template <typename T, XorListHook T::*Hook>
+IntrusiveXorListIterator<T, Hook>& IntrusiveXorListIterator<T, Hook>::operator++() {
+#if DEBUG
+    if (!is_valid())
+        throw YException("IntrusiveXorList iterator: Iterator is invalid because the list has been changed");
+#endif
+
+    auto next_node = xor_ptr(_prev_node, _node->ptr);
+    _prev_node = _node;
+    _node = next_node;
+    return *this;
+}
+
+template <typename T, XorListHook T::*Hook>
+IntrusiveXorListIterator<T, Hook>& IntrusiveXorListIterator<T, Hook>::operator--() {
+#if DEBUG
+    if (!is_valid())
+        throw YException("IntrusiveXorList iterator: Iterator is invalid because the list has been changed");
+#endif
+
+    auto very_prev_node = xor_ptr(_node, _prev_node->ptr);
+    _node = _prev_node;
+    _prev_node = very_prev_node;
+    return *this;
+}
+
+template <typename T, XorListHook T::*Hook>
+const IntrusiveXorListIterator<T, Hook> IntrusiveXorListIterator<T, Hook>::operator++(int) {
+    auto result = *this;
+    operator++();
+    return result;
+}
+
+template <typename T, XorListHook T::*Hook>
+const IntrusiveXorListIterator<T, Hook> IntrusiveXorListIterator<T, Hook>::operator--(int) {
+    auto result = *this;
+    operator--();
+    return result;
+}
+
+//----------------------------------------------------------------------------------
+
+template <typename T, XorListHook T::*Hook>
+bool IntrusiveXorListIterator<T, Hook>::operator==
+        (const IntrusiveXorListIterator<T, Hook>& other) const {
+    return _list == other._list and _node == other._node;
+}
+
+template <typename T, XorListHook T::*Hook>
+bool IntrusiveXorListIterator<T, Hook>::operator!=
+        (const IntrusiveXorListIterator<T, Hook>& other) const {
+    return not (*this == other);
+}
+
+template <typename T, XorListHook T::*Hook>
+T& IntrusiveXorListIterator<T, Hook>::operator*() {
+    return IntrusiveXorList<T, Hook>::to_object(_node);
+}
+
+template <typename T, XorListHook T::*Hook>
+T* IntrusiveXorListIterator<T, Hook>::operator->() {
+    return &IntrusiveXorList<T, Hook>::to_object(_node);
+}
+
+#if DEBUG
+template <typename T, XorListHook T::*Hook>
+bool IntrusiveXorListIterator<T, Hook>::is_valid() const {
+    return _version == _list->_version;
+}
+#endif
@@ -1,19 +1,61 @@
 #pragma once
+#include <algorithm>
+#include <cstdlib>
+#include <exception>
+#include <initializer_list>
+#include <istream>
 #include <iterator>
+#include <functional>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <thread>
 #include <type_traits>
+#include <vector>
+#include "list_io.h"
 #include "smallfunctions.h"
 
 template <typename T, class Alloc>
 class XorListIterator;
 
+template <typename T>
+class XorListRange;
+
+template <typename T, class Alloc>
+class XorListNodeHandle;
+
 template <typename T>
 struct XorListNode {
 public:
 	T value;
 	XorListNode* ptr;
 
-	template <typename U>
-    explicit XorListNode(U&& val): value(std::forward<U>(val)){}
+	template <typename... Args>
+    explicit XorListNode(Args&&... args): value(std::forward<Args>(args)...){}
+};
+
+// Arena allocators own the memory they hand out: n nodes taken with one
+// allocate(n) may later be freed one by one, or given up at once with
+// abandon(n), which leaves their memory to the arena until it is rewound
+// or destroyed.
+template <class Alloc>
+struct is_arena_allocator : std::false_type {};
+
+// The finger of iterator_at() and where compact_step() resumes. A list
+// makes them when it first needs them, so others pay a pointer for both.
+template <typename T>
+struct XorListCursors {
+	bool finger_enabled;
+	XorListNode<T>* finger_prev;
+	XorListNode<T>* finger_node;
+	size_t finger_index;
+	size_t finger_version;
+	XorListNode<T>* compact_prev;
+	XorListNode<T>* compact_node;
+	size_t compact_index;
+	size_t compact_version;
+
+	XorListCursors();
 };
 
 template <typename T, class Alloc = std::allocator<T> >
@@ -21,20 +63,32 @@ class XorList {
 public:
 	explicit XorList(const Alloc& alloc = Alloc());
     explicit XorList(size_t count, const T& value = T(), const Alloc& alloc = Alloc());
+    template <class ForwardIt, class = typename std::enable_if<
+            not std::is_integral<ForwardIt>::value>::type>
+    XorList(ForwardIt first, ForwardIt last, const Alloc& alloc = Alloc());
+    XorList(std::initializer_list<T>, const Alloc& alloc = Alloc());
 
 	XorList(const XorList<T, Alloc>&);
 	XorList(XorList<T, Alloc>&&) noexcept;
 	~XorList();
 
 	XorList<T, Alloc>& operator=(const XorList<T, Alloc>&);
-	XorList<T, Alloc>& operator=(XorList<T, Alloc>&&) noexcept;
+	// Moves elements one by one, which may throw, if the allocator doesn't
+	// propagate and isn't equal to the one of other.
+	XorList<T, Alloc>& operator=(XorList<T, Alloc>&&)
+			noexcept(std::allocator_traits<AllocNode>::propagate_on_container_move_assignment::value);
 
 	friend class XorListIterator<T, Alloc>;
 	typedef XorListIterator<T, Alloc> iterator;
 	typedef std::reverse_iterator<iterator> reverse_iterator;
-
+	typedef XorListNodeHandle<T, Alloc> node_type;
 
 	size_t size() const;
+	bool empty() const;
+	// Bytes taken by the list object and its nodes, as asked from allocator.
+	size_t memory_footprint() const;
+	Alloc get_allocator() const;
+	void swap(XorList<T, Alloc>&) noexcept;
 
 	T& back();
 	T& front();
@@ -44,18 +98,151 @@ public:
     template <typename U> iterator insert_before(iterator, U&&);
     template <typename U> iterator insert_after(iterator, U&&);
 
+    // Construct T in place from args; emplace() returns the new element.
+    template <typename... Args> void emplace_back(Args&&...);
+    template <typename... Args> void emplace_front(Args&&...);
+    template <typename... Args> iterator emplace(iterator, Args&&...);
+
+    // Unlinks the node of an element and hands it over without freeing it.
+    // insert() links such a node before pos and returns its element; the
+    // handle must come from a list with an equal allocator. No allocation
+    // and no moves of T either way.
+    node_type extract(iterator);
+    iterator insert(iterator pos, node_type&&);
+
+    // Node memory for a range is requested at once and linked in one pass.
+    template <class ForwardIt> iterator insert(iterator, ForwardIt, ForwardIt);
+    template <class ForwardIt> void assign(ForwardIt, ForwardIt);
+    void assign(std::initializer_list<T>);
+
 	void pop_back();
 	void pop_front();
-	void erase(iterator);
+	// Both return the iterator to the element after the erased ones. A
+	// range is unlinked with a fixed number of link rewrites.
+	iterator erase(iterator);
+	iterator erase(iterator first, iterator last);
+	// Filter the list in one pass, returning the number of erased
+	// elements. value may refer to an element of the list.
+	template <class Predicate> size_t remove_if(Predicate);
+	size_t remove(const T& value);
+	// When T is trivially destructible and the list holds the only copy of
+	// its arena allocator, clear() and the destructor reset the arena
+	// instead of freeing nodes one by one; markers of it are invalidated.
+	void clear();
+	// Like clear(), but when T is trivially destructible and Alloc is an
+	// arena allocator, gives all nodes up at once even if the arena is
+	// shared. Their memory is dead until the arena is rewound or reset,
+	// so use it only on a list whose arena is about to be.
+	void abandon();
+
+	// Relink nodes of other list, no allocations and no moves of T.
+	// Lists must use equal allocators.
+	void reverse();
+	void splice(iterator, XorList<T, Alloc>&);
+	void splice(iterator, XorList<T, Alloc>&, iterator, iterator);
+	void append(XorList<T, Alloc>&&);
+
+	// Move up to n front elements to out, freeing nodes on the way.
+	template <class OutputIt> OutputIt pop_front_n(size_t n, OutputIt out);
+	void drain_into(std::vector<T>&);
+
+	// Stable sort and merge relink nodes and never construct or move T.
+	// From parallel_threshold elements on, runs are sorted and merged by
+	// separate threads, so comp must be safe to call concurrently. If comp
+	// throws, the list keeps all its elements in an unspecified order.
+	void sort();
+	template <class Compare> void sort(Compare);
+	template <class Compare> void sort(Compare, size_t parallel_threshold,
+	                                   size_t threads = std::thread::hardware_concurrency());
+	void merge(XorList<T, Alloc>&&);
+	template <class Compare> void merge(XorList<T, Alloc>&&, Compare);
+	void unique();
+
+	// Binary dump for trivially copyable T, see list_io.h. load() replaces
+	// the contents, or leaves them if it throws, and takes the nodes for
+	// each block read with one allocation from arena allocators.
+	void save(std::ostream&) const;
+	void load(std::istream&);
+
+	// Moves the elements into fresh nodes taken in list order, so a walk
+	// touches memory sequentially again. Arena allocators give them as one
+	// block; others node by node, so the layout is up to their free lists.
+	// compact_step() moves at most budget elements on from where the
+	// previous step stopped and returns true once a pass reaches the end.
+	// Both invalidate iterators.
+	void compact();
+	bool compact_step(size_t budget);
+
+	// Positional access walks from the nearer end, or from the finger when
+	// the finger cache is on: the position last reached by iterator_at(),
+	// as long as the list hasn't changed since. Index size() gives end().
+	iterator iterator_at(size_t index);
+	T& at(size_t index);
+	iterator advance(iterator, std::ptrdiff_t);
+	void set_finger_cache(bool enabled);
+
+	// Internal iteration over raw nodes. The walk runs prefetch_distance
+	// nodes ahead of the visited one and prefetches them, so f overlaps
+	// with the pointer chase; 0 turns prefetching off. f must not change
+	// the structure of the list.
+	static constexpr size_t DEFAULT_PREFETCH_DISTANCE = 8;
+	template <class Function>
+	Function for_each(Function f, size_t prefetch_distance = DEFAULT_PREFETCH_DISTANCE);
+	template <typename U, class BinaryOp>
+	U accumulate(U init, BinaryOp op, size_t prefetch_distance = DEFAULT_PREFETCH_DISTANCE) const;
+	template <typename U>
+	U accumulate(U init) const;
+	template <class Predicate>
+	iterator find_if(Predicate pred, size_t prefetch_distance = DEFAULT_PREFETCH_DISTANCE);
 
 	iterator begin();
 	iterator end();
+	// Forward only range for loops, its iterators are two node pointers
+	// and the end is told by a null node alone.
+	XorListRange<T> forward_range();
 
 private:
     typedef XorListNode<T> node;
 
     void delete_nodes();
+    void delete_nodes(std::true_type);
+    void delete_nodes(std::false_type);
+    // false if nodes have to be freed one by one, see clear().
+    bool reset_arena();
+    bool reset_arena(std::true_type);
+    bool reset_arena(std::false_type);
+    // Returns the number of deleted nodes.
+    size_t delete_chain(node* chain_first);
+    iterator make_iterator(node* prev, node* cur);
+    template <typename... Args> node* create_node(Args&&...);
     void insert_node_before(node*, iterator&);
+    void link_chain(node* prev, node* next, node* chain_first, node* chain_last);
+    template <class Construct>
+    void build_chain(size_t count, Construct construct, node*& chain_first, node*& chain_last,
+                     bool contiguous = false);
+    void attach_chain(iterator& pos, node* chain_first, node* chain_last, size_t count);
+    // Freed nodes the allocator can give, counted up to limit.
+    size_t free_nodes(size_t limit, std::true_type) const;
+    size_t free_nodes(size_t limit, std::false_type) const;
+
+    // While sorting, ptr of every node holds the plain next pointer. If
+    // comp throws, merge_runs and sort_run leave all nodes in their output
+    // chain, in no particular order.
+    node* to_singly_linked();
+    void from_singly_linked(node* head);
+    static node* concat_chains(node* first, node* second);
+    template <class Compare> static void merge_runs(node* first, node* second, node*& result, Compare&);
+    template <class Compare> static void sort_run(node*& head, Compare&);
+    // Calls task(i) for i below count, each on its own thread or on this one
+    // if a thread can't be started. Returns the first exception thrown.
+    template <class Task> static std::exception_ptr run_tasks(size_t count, Task task);
+    void unlink_chain(node* prev, node* chain_first, node* chain_last, node* next);
+    node* relocate_chain(node* prev, node* chain_first, size_t count, node*& next);
+    XorListCursors<T>& cursors();
+    // Calls visit(node*) from the first node on until it returns false;
+    // prev and cur are left at the node it stopped on, or at the end.
+    template <class Visit>
+    void walk(Visit visit, size_t prefetch_distance, node*& prev, node*& cur) const;
 
     //Alloc _alloc;
     typedef typename Alloc::template rebind<node>::other AllocNode;
@@ -63,13 +250,14 @@ private:
 	XorListNode<T>* _first;
 	XorListNode<T>* _last;
 	size_t _size;
-#if DEBUG
-    uint _version;
-#endif
+	// Changes on every structural change; checks iterators in debug builds
+	// and the cursors always.
+	size_t _version;
+	std::unique_ptr<XorListCursors<T> > _cursors;
 };
 
 template <typename T, class Alloc>
-class XorListIterator : std::iterator<std::bidirectional_iterator_tag, T> {
+class XorListIterator : public std::iterator<std::bidirectional_iterator_tag, T> {
 public:
     friend class XorList<T, Alloc>;
 
@@ -90,10 +278,75 @@ private:
     XorListNode<T>* _prev_node;
 #if DEBUG
     bool is_valid() const;
-    uint _version;
+    size_t _version;
 #endif
 };
 
+template <typename T>
+class XorListForwardIterator : public std::iterator<std::forward_iterator_tag, T> {
+public:
+    XorListForwardIterator(XorListNode<T>* prev, XorListNode<T>* node);
+
+    XorListForwardIterator<T>& operator++();
+    T& operator*() const;
+    T* operator->() const;
+
+    bool operator==(const XorListForwardIterator<T>&) const;
+    bool operator!=(const XorListForwardIterator<T>&) const;
+
+private:
+    XorListNode<T>* _prev_node;
+    XorListNode<T>* _node;
+};
+
+// Stays valid while no nodes are added or removed from the list.
+template <typename T>
+class XorListRange {
+public:
+    typedef XorListForwardIterator<T> iterator;
+
+    explicit XorListRange(XorListNode<T>* first);
+    iterator begin() const;
+    iterator end() const;
+
+private:
+    XorListNode<T>* _first;
+};
+
+// Owns a node extracted from an XorList, together with a copy of the list
+// allocator to free it, until the node is inserted into a list again.
+template <typename T, class Alloc>
+class XorListNodeHandle {
+public:
+    XorListNodeHandle() noexcept;
+    XorListNodeHandle(XorListNodeHandle<T, Alloc>&&) noexcept;
+    ~XorListNodeHandle();
+
+    XorListNodeHandle(const XorListNodeHandle<T, Alloc>&) = delete;
+    XorListNodeHandle<T, Alloc>& operator=(const XorListNodeHandle<T, Alloc>&) = delete;
+    XorListNodeHandle<T, Alloc>& operator=(XorListNodeHandle<T, Alloc>&&) noexcept;
+
+    bool empty() const;
+    explicit operator bool() const;
+    T& value() const;
+    Alloc get_allocator() const;
+
+private:
+    friend class XorList<T, Alloc>;
+    typedef typename Alloc::template rebind<XorListNode<T> >::other AllocNode;
+
+    XorListNodeHandle(XorListNode<T>* node, const AllocNode& alloc);
+    AllocNode& alloc() const;
+    // Gives the node up, leaving the handle empty.
+    XorListNode<T>* release();
+    void reset();
+
+    XorListNode<T>* _node;
+    // Holds an allocator only while there is a node: a default constructed
+    // one may be costly, StackAllocator makes a whole arena.
+    mutable typename std::aligned_storage<sizeof(AllocNode), alignof(AllocNode)>::type _alloc;
+};
+
 template <typename T>
 XorListNode<T>* get_next(XorListNode<T>* first, XorListNode<T>* second);
 
@@ -105,54 +358,118 @@ XorListNode<T>* get_prev(XorListNode<T>* first, XorListNode<T>* second);
 
 using std::forward;
 
+template <typename T>
+XorListCursors<T>::XorListCursors():
+        finger_enabled(false),
+        finger_prev(nullptr), finger_node(nullptr),
+        finger_index(0), finger_version(0),
+        compact_prev(nullptr), compact_node(nullptr),
+        compact_index(0), compact_version(0)
+{}
+
 template<typename T, class Alloc>
 XorList<T, Alloc>::XorList(const Alloc& alloc):
         _alloc(alloc),
         _first(nullptr), _last(nullptr),
-        _size(0) {
-#if DEBUG
-    _version = 0;
-#endif
-}
+        _size(0),
+        _version(0)
+{}
 
 template<typename T, class Alloc>
 XorList<T, Alloc>::XorList(size_t count, const T& value,
-                           const Alloc& alloc): XorList() {
-    for (int i = 0; i < count; ++i) {
-        this->push_back(value);
-    }
+                           const Alloc& alloc): XorList(alloc) {
+    node* chain_first;
+    node* chain_last;
+    build_chain(count, [this, &value](node* place) {
+        _alloc.construct(place, value);
+    }, chain_first, chain_last);
+
+    auto it = end();
+    attach_chain(it, chain_first, chain_last, count);
+}
+
+template<typename T, class Alloc>
+template <class ForwardIt, class>
+XorList<T, Alloc>::XorList(ForwardIt first, ForwardIt last,
+                           const Alloc& alloc): XorList(alloc) {
+    insert(end(), first, last);
+}
+
+template<typename T, class Alloc>
+XorList<T, Alloc>::XorList(std::initializer_list<T> values,
+                           const Alloc& alloc): XorList(alloc) {
+    insert(end(), values.begin(), values.end());
 }
 
 template<typename T, class Alloc>
 XorList<T, Alloc>::XorList(const XorList<T, Alloc>& other):XorList() {
     _alloc = other._alloc;
     auto other_ptr = const_cast<XorList<T, Alloc>*>(&other);
-    for (auto it = other_ptr->begin(); it != other_ptr->end(); ++it) {
-        push_back(*it);
-    }
+    insert(end(), other_ptr->begin(), other_ptr->end());
 }
 
 template<typename T, class Alloc>
 XorList<T, Alloc>::XorList(XorList&& other) noexcept:
         _alloc(other._alloc),
         _first(other._first), _last(other._last),
-        _size(other._size) {
-#if DEBUG
-    _version = 0;
-#endif
+        _size(other._size),
+        _version(other._version),
+        _cursors(std::move(other._cursors)) {
     other._first = other._last = nullptr;
     other._size = 0;
+    other._version++;
 }
 
 template<typename T, class Alloc>
 XorList<T, Alloc>::~XorList() {
-    delete_nodes();
+    if (not reset_arena()) {
+        delete_chain(_first);
+    }
 }
 
 template <typename T, class Alloc>
 void XorList<T, Alloc>::delete_nodes() {
+    delete_nodes(std::integral_constant<bool, std::is_trivially_destructible<T>::value
+                                              and is_arena_allocator<Alloc>::value>());
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::delete_nodes(std::true_type) {
+    _alloc.abandon(_size);
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::delete_nodes(std::false_type) {
+    delete_chain(_first);
+}
+
+template <typename T, class Alloc>
+bool XorList<T, Alloc>::reset_arena() {
+    return reset_arena(std::integral_constant<bool, std::is_trivially_destructible<T>::value
+                                                    and is_arena_allocator<Alloc>::value>());
+}
+
+// With no other copy of the allocator, every block of the arena is a node.
+template <typename T, class Alloc>
+bool XorList<T, Alloc>::reset_arena(std::true_type) {
+    if (not _alloc.owns_arena()) {
+        return false;
+    }
+    _alloc.arena().reset();
+    return true;
+}
+
+template <typename T, class Alloc>
+bool XorList<T, Alloc>::reset_arena(std::false_type) {
+    return false;
+}
+
+// Chain is detached: outer links of its ends are nullptr.
+template <typename T, class Alloc>
+size_t XorList<T, Alloc>::delete_chain(node* chain_first) {
     node* first = nullptr;
-    node* second = _first;
+    node* second = chain_first;
+    size_t count = 0;
 
     while (second != nullptr) {
         node* next_node = get_next(first, second);
@@ -160,7 +477,9 @@ void XorList<T, Alloc>::delete_nodes() {
         second = next_node;
         _alloc.destroy(first);
         _alloc.deallocate(first, 1);
+        ++count;
     }
+    return count;
 }
 
 
@@ -168,66 +487,261 @@ void XorList<T, Alloc>::delete_nodes() {
 
 template <typename T, class Alloc>
 XorList<T, Alloc>& XorList<T, Alloc>::operator=(const XorList<T, Alloc>& other) {
-    delete_nodes();
-    _first = _last = nullptr;
-    _size = 0;
-#if DEBUG
-    _version++;
-#endif
-    auto other_ptr = const_cast<XorList<T, Alloc>*>(&other);
-    for (auto it = other_ptr->begin(); it != other_ptr->end(); ++it) {
-        push_back(*it);
+    if (this == &other) {
+        return *this;
     }
+    clear();
+    if (std::allocator_traits<AllocNode>::propagate_on_container_copy_assignment::value) {
+        _alloc = other._alloc;
+    }
+    auto other_ptr = const_cast<XorList<T, Alloc>*>(&other);
+    insert(end(), other_ptr->begin(), other_ptr->end());
+    return *this;
 }
 
 template <typename T, class Alloc>
-XorList<T, Alloc>& XorList<T, Alloc>::operator=(XorList && other) noexcept {
-    delete_nodes();
+XorList<T, Alloc>& XorList<T, Alloc>::operator=(XorList && other)
+        noexcept(std::allocator_traits<AllocNode>::propagate_on_container_move_assignment::value) {
+    if (this == &other) {
+        return *this;
+    }
+    clear();
+
+    if (not std::allocator_traits<AllocNode>::propagate_on_container_move_assignment::value
+            and not (_alloc == other._alloc)) {
+        // Nodes of other list can't be freed by our allocator
+        for (auto it = other.begin(); it != other.end(); ++it) {
+            push_back(std::move(*it));
+        }
+        return *this;
+    }
+
     _alloc = other._alloc;
     _first = other._first;
     _last = other._last;
     _size = other._size;
-#if DEBUG
-    _version++;
-#endif
 
     other._size = 0;
     other._first = other._last = nullptr;
+    other._version++;
+    return *this;
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::swap(XorList<T, Alloc>& other) noexcept {
+    if (std::allocator_traits<AllocNode>::propagate_on_container_swap::value) {
+        std::swap(_alloc, other._alloc);
+    }
+    std::swap(_first, other._first);
+    std::swap(_last, other._last);
+    std::swap(_size, other._size);
+    _version++;
+    other._version++;
 }
 
 //----------------------------------------------------------------------
 
 template <typename T, class Alloc>
 typename XorList<T, Alloc>::iterator XorList<T, Alloc>::begin() {
-    iterator iter;
-    iter._list = this;
-    iter._node = _first;
-    iter._prev_node = nullptr;
-#if DEBUG
-    iter._version = _version;
-#endif
-    return iter;
+    return make_iterator(nullptr, _first);
 }
 
 template <typename T, class Alloc>
 typename XorList<T, Alloc>::iterator XorList<T, Alloc>::end() {
+    return make_iterator(_last, nullptr);
+}
+
+template <typename T, class Alloc>
+typename XorList<T, Alloc>::iterator XorList<T, Alloc>::make_iterator(node* prev, node* cur) {
     iterator iter;
     iter._list = this;
-    iter._node = nullptr;
-    iter._prev_node = _last;
+    iter._node = cur;
+    iter._prev_node = prev;
 #if DEBUG
     iter._version = _version;
 #endif
     return iter;
 }
 
+template <typename T, class Alloc>
+XorListRange<T> XorList<T, Alloc>::forward_range() {
+    return XorListRange<T>(_first);
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, class Alloc>
+constexpr size_t XorList<T, Alloc>::DEFAULT_PREFETCH_DISTANCE;
+
+// The lookahead walk is the same dependent chain of loads, but visiting
+// a node never waits for it: the node was prefetched distance steps ago.
+template <typename T, class Alloc>
+template <class Visit>
+void XorList<T, Alloc>::walk(Visit visit, size_t prefetch_distance,
+                             node*& prev, node*& cur) const {
+    node* ahead_prev = nullptr;
+    node* ahead = _first;
+    for (size_t i = 0; i < prefetch_distance and ahead != nullptr; ++i) {
+        node* next_node = get_next(ahead_prev, ahead);
+        ahead_prev = ahead;
+        ahead = next_node;
+        prefetch(ahead);
+    }
+
+    prev = nullptr;
+    cur = _first;
+    while (cur != nullptr) {
+        if (prefetch_distance != 0 and ahead != nullptr) {
+            node* next_node = get_next(ahead_prev, ahead);
+            ahead_prev = ahead;
+            ahead = next_node;
+            prefetch(ahead);
+        }
+        if (not visit(cur)) {
+            return;
+        }
+        node* next_node = get_next(prev, cur);
+        prev = cur;
+        cur = next_node;
+    }
+}
+
+template <typename T, class Alloc>
+template <class Function>
+Function XorList<T, Alloc>::for_each(Function f, size_t prefetch_distance) {
+    node* prev;
+    node* cur;
+    walk([&f](node* visited) {
+        f(visited->value);
+        return true;
+    }, prefetch_distance, prev, cur);
+    return f;
+}
+
+template <typename T, class Alloc>
+template <typename U, class BinaryOp>
+U XorList<T, Alloc>::accumulate(U init, BinaryOp op, size_t prefetch_distance) const {
+    node* prev;
+    node* cur;
+    walk([&init, &op](node* visited) {
+        init = op(std::move(init), visited->value);
+        return true;
+    }, prefetch_distance, prev, cur);
+    return init;
+}
+
+template <typename T, class Alloc>
+template <typename U>
+U XorList<T, Alloc>::accumulate(U init) const {
+    return accumulate(std::move(init), std::plus<>());
+}
+
+template <typename T, class Alloc>
+template <class Predicate>
+typename XorList<T, Alloc>::iterator XorList<T, Alloc>::find_if
+        (Predicate pred, size_t prefetch_distance) {
+    node* prev;
+    node* cur;
+    walk([&pred](node* visited) {
+        return not pred(visited->value);
+    }, prefetch_distance, prev, cur);
+
+    return make_iterator(prev, cur);
+}
+
 //----------------------------------------------------------------------
 
+template <typename T, class Alloc>
+typename XorList<T, Alloc>::iterator XorList<T, Alloc>::advance(iterator iter, std::ptrdiff_t n) {
+    for (; n > 0; --n) {
+        ++iter;
+    }
+    for (; n < 0; ++n) {
+        --iter;
+    }
+    return iter;
+}
+
+// A fresh list has its finger at index 0, which never beats begin().
+template <typename T, class Alloc>
+typename XorList<T, Alloc>::iterator XorList<T, Alloc>::iterator_at(size_t index) {
+    if (index > _size)
+        throw YException("XorList: index is out of range");
+
+    iterator result;
+    std::ptrdiff_t steps;
+    if (index <= _size - index) {
+        result = begin();
+        steps = (std::ptrdiff_t)index;
+    }
+    else {
+        result = end();
+        steps = -(std::ptrdiff_t)(_size - index);
+    }
+
+    XorListCursors<T>* finger = _cursors and _cursors->finger_enabled ? _cursors.get() : nullptr;
+    if (finger != nullptr and finger->finger_version == _version) {
+        std::ptrdiff_t from_finger = (std::ptrdiff_t)index - (std::ptrdiff_t)finger->finger_index;
+        if (std::abs(from_finger) < std::abs(steps)) {
+            result._node = finger->finger_node;
+            result._prev_node = finger->finger_prev;
+            steps = from_finger;
+        }
+    }
+    result = advance(result, steps);
+
+    if (finger != nullptr) {
+        finger->finger_prev = result._prev_node;
+        finger->finger_node = result._node;
+        finger->finger_index = index;
+        finger->finger_version = _version;
+    }
+    return result;
+}
+
+template <typename T, class Alloc>
+T& XorList<T, Alloc>::at(size_t index) {
+    if (index >= _size)
+        throw YException("XorList: index is out of range");
+
+    return *iterator_at(index);
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::set_finger_cache(bool enabled) {
+    if (enabled or _cursors) {
+        cursors().finger_enabled = enabled;
+    }
+}
+
+template <typename T, class Alloc>
+XorListCursors<T>& XorList<T, Alloc>::cursors() {
+    if (not _cursors) {
+        _cursors.reset(new XorListCursors<T>());
+    }
+    return *_cursors;
+}
+
 template <typename T, class Alloc>
 size_t XorList<T, Alloc>::size() const {
     return _size;
 }
 
+template <typename T, class Alloc>
+bool XorList<T, Alloc>::empty() const {
+    return _size == 0;
+}
+
+template <typename T, class Alloc>
+size_t XorList<T, Alloc>::memory_footprint() const {
+    return sizeof(*this) + _size * sizeof(node);
+}
+
+template <typename T, class Alloc>
+Alloc XorList<T, Alloc>::get_allocator() const {
+    return Alloc(_alloc);
+}
+
 //-----------------------------------------------------------------------
 
 template<typename T>
@@ -263,14 +777,28 @@ void XorList<T, Alloc>::insert_node_before(XorList<T, Alloc>::node* node_for_ins
     iter._prev_node = node_for_insert;
 
     _size++;
-#if DEBUG
     _version++;
+#if DEBUG
     iter._version++;
 #endif
 }
 
 //-----------------------------------------------------------------------------
 
+template <typename T, class Alloc>
+template <typename... Args>
+typename XorList<T, Alloc>::node* XorList<T, Alloc>::create_node(Args&&... args) {
+    node* new_node = _alloc.allocate(1);
+    try {
+        _alloc.construct(new_node, std::forward<Args>(args)...);
+    }
+    catch (...) {
+        _alloc.deallocate(new_node, 1);
+        throw;
+    }
+    return new_node;
+}
+
 template<typename T, class Alloc>
 template <typename U>
 typename XorList<T, Alloc>::iterator XorList<T, Alloc>::insert_before
@@ -282,12 +810,39 @@ typename XorList<T, Alloc>::iterator XorList<T, Alloc>::insert_before
         throw YException("XorList: trying to use iterator from other list");
 #endif
 
-    node* new_node = _alloc.allocate(1);
-    _alloc.construct(new_node, std::forward<U>(value));
-    insert_node_before(new_node, iter);
+    insert_node_before(create_node(std::forward<U>(value)), iter);
     return iter;
 }
 
+template <typename T, class Alloc>
+template <typename... Args>
+typename XorList<T, Alloc>::iterator XorList<T, Alloc>::emplace
+        (iterator pos, Args&&... args) {
+#ifdef DEBUG
+    if (pos._version != this->_version)
+        throw YException("XorList: Iterator is invalid because the list has been changed");
+    if (pos._list != this)
+        throw YException("XorList: trying to use iterator from other list");
+#endif
+
+    insert_node_before(create_node(std::forward<Args>(args)...), pos);
+    return --pos;
+}
+
+template <typename T, class Alloc>
+template <typename... Args>
+void XorList<T, Alloc>::emplace_back(Args&&... args) {
+    auto it = end();
+    insert_node_before(create_node(std::forward<Args>(args)...), it);
+}
+
+template <typename T, class Alloc>
+template <typename... Args>
+void XorList<T, Alloc>::emplace_front(Args&&... args) {
+    auto it = begin();
+    insert_node_before(create_node(std::forward<Args>(args)...), it);
+}
+
 template<typename T, class Alloc>
 template <typename U>
 typename XorList<T, Alloc>::iterator XorList<T, Alloc>::insert_after
@@ -320,7 +875,7 @@ void XorList<T, Alloc>::push_front(U&& value) {
 //---------------------------------------------------------------------------------
 
 template<typename T, class Alloc>
-void XorList<T, Alloc>::erase(XorList<T, Alloc>::iterator iter) {
+typename XorList<T, Alloc>::iterator XorList<T, Alloc>::erase(XorList<T, Alloc>::iterator iter) {
 #ifdef DEBUG
     if (iter._node == nullptr)
         throw YException("XorList: trying to erase element after last");
@@ -350,9 +905,148 @@ void XorList<T, Alloc>::erase(XorList<T, Alloc>::iterator iter) {
     _alloc.deallocate(iter._node, 1);
 
     --_size;
-#if DEBUG
     ++_version;
+    return make_iterator(iter._prev_node, next_node);
+}
+
+template <typename T, class Alloc>
+typename XorList<T, Alloc>::iterator XorList<T, Alloc>::erase(iterator first, iterator last) {
+#ifdef DEBUG
+    if (first._version != this->_version or last._version != this->_version)
+        throw YException("XorList: Iterator is invalid because the list has been changed");
+    if (first._list != this or last._list != this)
+        throw YException("XorList: trying to use iterator from other list");
+#endif
+
+    if (first == last) {
+        return last;
+    }
+
+    unlink_chain(first._prev_node, first._node, last._prev_node, last._node);
+    _size -= delete_chain(first._node);
+    ++_version;
+    return make_iterator(first._prev_node, last._node);
+}
+
+// Kept nodes are relinked behind the walk, once the next kept one is
+// known; erased ones are queued through plain next pointers and freed
+// after it, so value stays alive to the end even if its node is erased.
+// If pred throws, the unvisited rest of the list is kept as it is.
+template <typename T, class Alloc>
+template <class Predicate>
+size_t XorList<T, Alloc>::remove_if(Predicate pred) {
+    node* kept_prev = nullptr;
+    node* kept_last = nullptr;
+    node* erased_first = nullptr;
+    node* erased_last = nullptr;
+    size_t erased = 0;
+
+    auto free_erased = [&]() {
+        while (erased_first != nullptr) {
+            node* next_node = erased_first->ptr;
+            _alloc.destroy(erased_first);
+            _alloc.deallocate(erased_first, 1);
+            erased_first = next_node;
+        }
+        if (erased != 0) {
+            _size -= erased;
+            _version++;
+        }
+    };
+
+    node* prev = nullptr;
+    node* cur = _first;
+    try {
+        while (cur != nullptr) {
+            node* next_node = get_next(prev, cur);
+            if (pred(cur->value)) {
+                cur->ptr = nullptr;
+                if (erased_last != nullptr) {
+                    erased_last->ptr = cur;
+                }
+                else {
+                    erased_first = cur;
+                }
+                erased_last = cur;
+                ++erased;
+            }
+            else {
+                if (kept_last != nullptr) {
+                    kept_last->ptr = xor_ptr(kept_prev, cur);
+                }
+                else {
+                    _first = cur;
+                }
+                kept_prev = kept_last;
+                kept_last = cur;
+            }
+            prev = cur;
+            cur = next_node;
+        }
+    }
+    catch (...) {
+        cur->ptr = xor_ptr(cur->ptr, prev, kept_last);
+        if (kept_last != nullptr) {
+            kept_last->ptr = xor_ptr(kept_prev, cur);
+        }
+        else {
+            _first = cur;
+        }
+        free_erased();
+        throw;
+    }
+
+    if (kept_last != nullptr) {
+        kept_last->ptr = kept_prev;
+    }
+    else {
+        _first = nullptr;
+    }
+    _last = kept_last;
+    free_erased();
+    return erased;
+}
+
+template <typename T, class Alloc>
+size_t XorList<T, Alloc>::remove(const T& value) {
+    return remove_if([&value](const T& element) {
+        return element == value;
+    });
+}
+
+template <typename T, class Alloc>
+typename XorList<T, Alloc>::node_type XorList<T, Alloc>::extract(iterator iter) {
+#ifdef DEBUG
+    if (iter._node == nullptr)
+        throw YException("XorList: trying to extract element after last");
+    if (iter._version != this->_version)
+        throw YException("XorList: Iterator is invalid because the list has been changed");
+    if (iter._list != this)
+        throw YException("XorList: trying to use iterator from other list");
+#endif
+
+    unlink_chain(iter._prev_node, iter._node, iter._node, get_next(iter._prev_node, iter._node));
+    --_size;
+    ++_version;
+    return node_type(iter._node, _alloc);
+}
+
+template <typename T, class Alloc>
+typename XorList<T, Alloc>::iterator XorList<T, Alloc>::insert(iterator pos, node_type&& handle) {
+#ifdef DEBUG
+    if (pos._version != this->_version)
+        throw YException("XorList: Iterator is invalid because the list has been changed");
+    if (pos._list != this)
+        throw YException("XorList: trying to use iterator from other list");
+    if (not handle.empty() and not (_alloc == handle.alloc()))
+        throw YException("XorList: trying to insert node with other allocator");
 #endif
+
+    if (handle.empty()) {
+        return pos;
+    }
+    insert_node_before(handle.release(), pos);
+    return --pos;
 }
 
 template<typename T, class Alloc>
@@ -367,10 +1061,705 @@ void XorList<T, Alloc>::pop_front() {
     erase(begin());
 }
 
-//---------------------------------------------------------------------------------
+template<typename T, class Alloc>
+void XorList<T, Alloc>::clear() {
+    if (not reset_arena()) {
+        delete_chain(_first);
+    }
+    _first = _last = nullptr;
+    _size = 0;
+    _version++;
+}
 
 template<typename T, class Alloc>
-T& XorList<T, Alloc>::back() {
+void XorList<T, Alloc>::abandon() {
+    delete_nodes();
+    _first = _last = nullptr;
+    _size = 0;
+    _version++;
+}
+
+//---------------------------------------------------------------------------------
+
+// Chain is detached: outer links of its ends are nullptr.
+template <typename T, class Alloc>
+void XorList<T, Alloc>::link_chain(node* prev, node* next,
+                                   node* chain_first, node* chain_last) {
+    chain_first->ptr = xor_ptr(chain_first->ptr, prev);
+    chain_last->ptr = xor_ptr(chain_last->ptr, next);
+
+    if (prev != nullptr) {
+        prev->ptr = xor_ptr(prev->ptr, next, chain_first);
+    }
+    else {
+        _first = chain_first;
+    }
+
+    if (next != nullptr) {
+        next->ptr = xor_ptr(next->ptr, prev, chain_last);
+    }
+    else {
+        _last = chain_last;
+    }
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::unlink_chain(node* prev, node* chain_first,
+                                     node* chain_last, node* next) {
+    if (prev != nullptr) {
+        prev->ptr = xor_ptr(prev->ptr, chain_first, next);
+    }
+    else {
+        _first = next;
+    }
+
+    if (next != nullptr) {
+        next->ptr = xor_ptr(next->ptr, chain_last, prev);
+    }
+    else {
+        _last = prev;
+    }
+
+    chain_first->ptr = xor_ptr(chain_first->ptr, prev);
+    chain_last->ptr = xor_ptr(chain_last->ptr, next);
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::reverse() {
+    std::swap(_first, _last);
+    _version++;
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::splice(iterator pos, XorList<T, Alloc>& other) {
+#ifdef DEBUG
+    if (pos._version != this->_version)
+        throw YException("XorList: Iterator is invalid because the list has been changed");
+    if (pos._list != this)
+        throw YException("XorList: trying to use iterator from other list");
+    if (not (_alloc == other._alloc))
+        throw YException("XorList: trying to splice list with other allocator");
+#endif
+
+    if (&other == this or other._size == 0) {
+        return;
+    }
+
+    link_chain(pos._prev_node, pos._node, other._first, other._last);
+    _size += other._size;
+
+    other._first = other._last = nullptr;
+    other._size = 0;
+    _version++;
+    other._version++;
+}
+
+// Takes O(last - first) only to count moved elements when lists differ.
+template <typename T, class Alloc>
+void XorList<T, Alloc>::splice(iterator pos, XorList<T, Alloc>& other,
+                               iterator first, iterator last) {
+#ifdef DEBUG
+    if (pos._version != this->_version)
+        throw YException("XorList: Iterator is invalid because the list has been changed");
+    if (pos._list != this or first._list != &other or last._list != &other)
+        throw YException("XorList: trying to use iterator from other list");
+    if (not (_alloc == other._alloc))
+        throw YException("XorList: trying to splice list with other allocator");
+#endif
+
+    if (first == last or (&other == this and (pos == first or pos == last))) {
+        return;
+    }
+
+    size_t count = 0;
+    if (&other != this) {
+        for (auto it = first; it != last; ++it) {
+            ++count;
+        }
+    }
+
+    node* chain_first = first._node;
+    node* chain_last = last._prev_node;
+    other.unlink_chain(first._prev_node, chain_first, chain_last, last._node);
+    link_chain(pos._prev_node, pos._node, chain_first, chain_last);
+
+    other._size -= count;
+    _size += count;
+    _version++;
+    other._version++;
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::append(XorList<T, Alloc>&& other) {
+    splice(end(), other);
+}
+
+//---------------------------------------------------------------------------------
+
+// Arena allocators give the nodes they have freed one by one and the rest,
+// or all count nodes if contiguous, with one allocate call; others give
+// node by node. If contiguous, all nodes are taken before the first is
+// built. On exception every built node is freed.
+template <typename T, class Alloc>
+template <class Construct>
+void XorList<T, Alloc>::build_chain(size_t count, Construct construct,
+                                    node*& chain_first, node*& chain_last, bool contiguous) {
+    chain_first = chain_last = nullptr;
+    if (count == 0) {
+        return;
+    }
+
+    size_t recycled = count;
+    if (is_arena_allocator<Alloc>::value) {
+        recycled = contiguous ? 0 : free_nodes(count, is_arena_allocator<Alloc>());
+    }
+    node* block = recycled < count ? _alloc.allocate(count - recycled) : nullptr;
+    std::vector<node*> taken;
+    if (contiguous and recycled != 0) {
+        taken.reserve(count);
+        try {
+            while (taken.size() < count) {
+                taken.push_back(_alloc.allocate(1));
+            }
+        }
+        catch (...) {
+            for (node* cur : taken) {
+                _alloc.deallocate(cur, 1);
+            }
+            throw;
+        }
+    }
+
+    node* prev = nullptr;
+    size_t built = 0;
+    try {
+        for (; built < count; ++built) {
+            node* cur = built >= recycled ? block + (built - recycled)
+                                          : taken.empty() ? _alloc.allocate(1) : taken[built];
+            try {
+                construct(cur);
+            }
+            catch (...) {
+                if (built < recycled) {
+                    _alloc.deallocate(cur, 1);
+                }
+                throw;
+            }
+
+            cur->ptr = prev;
+            if (prev != nullptr) {
+                prev->ptr = xor_ptr(prev->ptr, cur);
+            }
+            else {
+                chain_first = cur;
+            }
+            prev = cur;
+        }
+    }
+    catch (...) {
+        delete_chain(chain_first);
+        for (size_t i = built + 1; i < taken.size(); ++i) {
+            _alloc.deallocate(taken[i], 1);
+        }
+        for (built = std::max(built, recycled); built < count; ++built) {
+            _alloc.deallocate(block + (built - recycled), 1);
+        }
+        throw;
+    }
+    chain_last = prev;
+}
+
+template <typename T, class Alloc>
+size_t XorList<T, Alloc>::free_nodes(size_t limit, std::true_type) const {
+    return _alloc.free_blocks(limit);
+}
+
+template <typename T, class Alloc>
+size_t XorList<T, Alloc>::free_nodes(size_t, std::false_type) const {
+    return 0;
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::attach_chain(iterator& pos, node* chain_first,
+                                     node* chain_last, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    link_chain(pos._prev_node, pos._node, chain_first, chain_last);
+    pos._prev_node = chain_last;
+    _size += count;
+    _version++;
+#if DEBUG
+    pos._version++;
+#endif
+}
+
+template <typename T, class Alloc>
+template <class ForwardIt>
+typename XorList<T, Alloc>::iterator XorList<T, Alloc>::insert
+        (iterator pos, ForwardIt first, ForwardIt last) {
+#ifdef DEBUG
+    if (pos._version != this->_version)
+        throw YException("XorList: Iterator is invalid because the list has been changed");
+    if (pos._list != this)
+        throw YException("XorList: trying to use iterator from other list");
+#endif
+
+    auto count = (size_t)std::distance(first, last);
+    node* chain_first;
+    node* chain_last;
+    build_chain(count, [this, &first](node* place) {
+        _alloc.construct(place, *first);
+        ++first;
+    }, chain_first, chain_last);
+
+    attach_chain(pos, chain_first, chain_last, count);
+    return pos;
+}
+
+template <typename T, class Alloc>
+template <class ForwardIt>
+void XorList<T, Alloc>::assign(ForwardIt first, ForwardIt last) {
+    clear();
+    insert(end(), first, last);
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::assign(std::initializer_list<T> values) {
+    assign(values.begin(), values.end());
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::save(std::ostream& out) const {
+    auto self = const_cast<XorList<T, Alloc>*>(this);
+    write_xor_list_dump<T>(out, self->begin(), _size);
+}
+
+// Values are read a block at a time into a staging buffer while the chain
+// is built, so a failed read leaves the list as it was.
+template <typename T, class Alloc>
+void XorList<T, Alloc>::load(std::istream& in) {
+    XorListDumpReader<T> reader(in);
+    const size_t block = std::max((size_t)1, XOR_LIST_IO_BLOCK / sizeof(T));
+    typedef typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    std::unique_ptr<storage[]> buffer(new storage[block]);
+    auto values = reinterpret_cast<T*>(buffer.get());
+
+    // Nodes are taken as values arrive, so a count the stream doesn't
+    // hold throws before it can take much memory.
+    XorList<T, Alloc> loaded(get_allocator());
+    size_t staged;
+    while ((staged = reader.read(values, block)) != 0) {
+        size_t index = 0;
+        node* chain_first;
+        node* chain_last;
+        loaded.build_chain(staged, [&](node* place) {
+            loaded._alloc.construct(place, values[index++]);
+        }, chain_first, chain_last);
+        auto it = loaded.end();
+        loaded.attach_chain(it, chain_first, chain_last, staged);
+    }
+    swap(loaded);
+}
+
+// Replaces count nodes from chain_first on with a built copy of them and
+// returns its last node; next gets the node after them. All nodes are
+// taken before the first value is moved, and values are moved only if
+// that can't throw, so a failed build leaves the list as it was.
+template <typename T, class Alloc>
+typename XorList<T, Alloc>::node* XorList<T, Alloc>::relocate_chain
+        (node* prev, node* chain_first, size_t count, node*& next) {
+    node* old_prev = prev;
+    node* old = chain_first;
+    node* new_first;
+    node* new_last;
+    build_chain(count, [&](node* place) {
+        _alloc.construct(place, std::move_if_noexcept(old->value));
+        node* next_node = get_next(old_prev, old);
+        old_prev = old;
+        old = next_node;
+    }, new_first, new_last, true);
+
+    next = old;
+    unlink_chain(prev, chain_first, old_prev, next);
+    link_chain(prev, next, new_first, new_last);
+    delete_chain(chain_first);
+    return new_last;
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::compact() {
+    if (_size == 0) {
+        return;
+    }
+
+    node* next;
+    relocate_chain(nullptr, _first, _size, next);
+    _version++;
+}
+
+template <typename T, class Alloc>
+bool XorList<T, Alloc>::compact_step(size_t budget) {
+    XorListCursors<T>& state = cursors();
+    if (state.compact_version != _version or state.compact_node == nullptr) {
+        if (state.compact_index >= _size) {
+            state.compact_index = 0;
+        }
+        iterator pos = iterator_at(state.compact_index);
+        state.compact_prev = pos._prev_node;
+        state.compact_node = pos._node;
+    }
+
+    size_t count = std::min(budget, _size - state.compact_index);
+    if (count != 0) {
+        state.compact_prev = relocate_chain(state.compact_prev, state.compact_node, count, state.compact_node);
+        state.compact_index += count;
+        _version++;
+    }
+    state.compact_version = _version;
+
+    if (state.compact_node == nullptr) {
+        state.compact_index = 0;
+        return true;
+    }
+    return false;
+}
+
+template <typename T, class Alloc>
+template <class OutputIt>
+OutputIt XorList<T, Alloc>::pop_front_n(size_t n, OutputIt out) {
+    n = std::min(n, _size);
+    _version++;
+
+    // Each node is unlinked before it is freed, so the list stays valid
+    // if writing to out throws.
+    for (size_t i = 0; i < n; ++i) {
+        node* cur = _first;
+        node* next_node = cur->ptr;
+        *out = std::move(cur->value);
+        ++out;
+
+        _first = next_node;
+        if (next_node != nullptr) {
+            next_node->ptr = xor_ptr(next_node->ptr, cur);
+        }
+        else {
+            _last = nullptr;
+        }
+        _size--;
+        _alloc.destroy(cur);
+        _alloc.deallocate(cur, 1);
+    }
+    return out;
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::drain_into(std::vector<T>& out) {
+    out.reserve(out.size() + _size);
+    pop_front_n(_size, std::back_inserter(out));
+}
+
+//---------------------------------------------------------------------------------
+
+template <typename T, class Alloc>
+typename XorList<T, Alloc>::node* XorList<T, Alloc>::to_singly_linked() {
+    node* prev = nullptr;
+    node* cur = _first;
+    while (cur != nullptr) {
+        node* next_node = get_next(prev, cur);
+        cur->ptr = next_node;
+        prev = cur;
+        cur = next_node;
+    }
+    return _first;
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::from_singly_linked(node* head) {
+    node* prev = nullptr;
+    node* cur = head;
+    while (cur != nullptr) {
+        node* next_node = cur->ptr;
+        cur->ptr = xor_ptr(prev, next_node);
+        prev = cur;
+        cur = next_node;
+    }
+
+    _first = head;
+    _last = prev;
+    _version++;
+}
+
+template <typename T, class Alloc>
+typename XorList<T, Alloc>::node* XorList<T, Alloc>::concat_chains(node* first, node* second) {
+    if (first == nullptr) {
+        return second;
+    }
+    node* last = first;
+    while (last->ptr != nullptr) {
+        last = last->ptr;
+    }
+    last->ptr = second;
+    return first;
+}
+
+// Ties are taken from first, which keeps the merge stable. result may be
+// the variable first or second came from.
+template <typename T, class Alloc>
+template <class Compare>
+void XorList<T, Alloc>::merge_runs(node* first, node* second, node*& result, Compare& comp) {
+    result = nullptr;
+    node** tail = &result;
+
+    try {
+        while (first != nullptr and second != nullptr) {
+            if (comp(second->value, first->value)) {
+                *tail = second;
+                tail = &second->ptr;
+                second = second->ptr;
+            }
+            else {
+                *tail = first;
+                tail = &first->ptr;
+                first = first->ptr;
+            }
+        }
+    }
+    catch (...) {
+        *tail = concat_chains(first, second);
+        throw;
+    }
+    *tail = first != nullptr ? first : second;
+}
+
+// Bottom-up merge sort: bins[i] holds a sorted run of 2^i nodes that came
+// before everything in the lower bins.
+template <typename T, class Alloc>
+template <class Compare>
+void XorList<T, Alloc>::sort_run(node*& head, Compare& comp) {
+    const size_t bins_count = 64;
+    node* bins[bins_count] = {};
+    node* run = nullptr;
+
+    try {
+        while (head != nullptr) {
+            run = head;
+            head = head->ptr;
+            run->ptr = nullptr;
+
+            size_t i = 0;
+            for (; bins[i] != nullptr; ++i) {
+                node* bin = bins[i];
+                bins[i] = nullptr;
+                merge_runs(bin, run, run, comp);
+                if (i + 1 == bins_count) {
+                    break;
+                }
+            }
+            bins[i] = run;
+            run = nullptr;
+        }
+
+        for (size_t i = 0; i < bins_count; ++i) {
+            if (bins[i] != nullptr) {
+                node* bin = bins[i];
+                bins[i] = nullptr;
+                merge_runs(bin, run, run, comp);
+            }
+        }
+    }
+    catch (...) {
+        head = concat_chains(run, head);
+        for (size_t i = 0; i < bins_count; ++i) {
+            head = concat_chains(bins[i], head);
+        }
+        throw;
+    }
+    head = run;
+}
+
+template <typename T, class Alloc>
+template <class Task>
+std::exception_ptr XorList<T, Alloc>::run_tasks(size_t count, Task task) {
+    std::vector<std::exception_ptr> errors(count);
+    auto guarded = [&task, &errors](size_t i) {
+        try {
+            task(i);
+        }
+        catch (...) {
+            errors[i] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    workers.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        try {
+            workers.emplace_back(guarded, i);
+        }
+        catch (...) {
+            guarded(i);
+        }
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+
+    for (auto& error : errors) {
+        if (error != nullptr) {
+            return error;
+        }
+    }
+    return nullptr;
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::sort() {
+    sort(std::less<T>());
+}
+
+template <typename T, class Alloc>
+template <class Compare>
+void XorList<T, Alloc>::sort(Compare comp) {
+    node* head = to_singly_linked();
+    try {
+        sort_run(head, comp);
+    }
+    catch (...) {
+        from_singly_linked(head);
+        throw;
+    }
+    from_singly_linked(head);
+}
+
+// Between rounds every node is in some chain of runs, so whatever throws,
+// the runs can be joined back into the list.
+template <typename T, class Alloc>
+template <class Compare>
+void XorList<T, Alloc>::sort(Compare comp, size_t parallel_threshold, size_t threads) {
+    if (_size < parallel_threshold or threads < 2 or _size < 2) {
+        sort(comp);
+        return;
+    }
+
+    size_t run_size = div_ceil(_size, std::min(threads, _size));
+    std::vector<node*> runs(div_ceil(_size, run_size));
+    node* cur = to_singly_linked();
+    for (size_t i = 0; i < runs.size(); ++i) {
+        runs[i] = cur;
+        for (size_t j = 1; j < run_size and cur->ptr != nullptr; ++j) {
+            cur = cur->ptr;
+        }
+        node* next_run = cur->ptr;
+        cur->ptr = nullptr;
+        cur = next_run;
+    }
+
+    std::exception_ptr error;
+    try {
+        error = run_tasks(runs.size(), [&runs, &comp](size_t i) {
+            sort_run(runs[i], comp);
+        });
+
+        while (error == nullptr and runs.size() > 1) {
+            std::vector<node*> merged((runs.size() + 1) / 2);
+            if (runs.size() % 2 == 1) {
+                merged.back() = runs.back();
+            }
+            error = run_tasks(runs.size() / 2, [&runs, &merged, &comp](size_t i) {
+                merge_runs(runs[2 * i], runs[2 * i + 1], merged[i], comp);
+            });
+            runs.swap(merged);
+        }
+    }
+    catch (...) {
+        error = std::current_exception();
+    }
+
+    if (error != nullptr) {
+        node* head = nullptr;
+        for (node* run : runs) {
+            head = concat_chains(run, head);
+        }
+        from_singly_linked(head);
+        std::rethrow_exception(error);
+    }
+    from_singly_linked(runs[0]);
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::merge(XorList<T, Alloc>&& other) {
+    merge(std::move(other), std::less<T>());
+}
+
+template <typename T, class Alloc>
+template <class Compare>
+void XorList<T, Alloc>::merge(XorList<T, Alloc>&& other, Compare comp) {
+#ifdef DEBUG
+    if (not (_alloc == other._alloc))
+        throw YException("XorList: trying to merge list with other allocator");
+#endif
+
+    if (&other == this) {
+        return;
+    }
+
+    node* first = to_singly_linked();
+    node* second = other.to_singly_linked();
+    _size += other._size;
+    other._first = other._last = nullptr;
+    other._size = 0;
+    other._version++;
+
+    node* head;
+    try {
+        merge_runs(first, second, head, comp);
+    }
+    catch (...) {
+        from_singly_linked(head);
+        throw;
+    }
+    from_singly_linked(head);
+}
+
+template <typename T, class Alloc>
+void XorList<T, Alloc>::unique() {
+    if (_first == nullptr) {
+        return;
+    }
+
+    node* prev = nullptr;
+    node* cur = _first;
+    node* next_node = get_next(prev, cur);
+    while (next_node != nullptr) {
+        if (next_node->value == cur->value) {
+            node* after_next = get_next(cur, next_node);
+            cur->ptr = xor_ptr(cur->ptr, next_node, after_next);
+            if (after_next != nullptr) {
+                after_next->ptr = xor_ptr(after_next->ptr, next_node, cur);
+            }
+            else {
+                _last = cur;
+            }
+            _alloc.destroy(next_node);
+            _alloc.deallocate(next_node, 1);
+            --_size;
+            next_node = after_next;
+        }
+        else {
+            prev = cur;
+            cur = next_node;
+            next_node = get_next(prev, cur);
+        }
+    }
+    _version++;
+}
+
+//---------------------------------------------------------------------------------
+
+template<typename T, class Alloc>
+T& XorList<T, Alloc>::back() {
     if (_size == 0)
         throw YException("XorList: trying to get elements from empty list");
 
@@ -453,6 +1842,140 @@ T* XorListIterator<T, Alloc>::operator->() {
     return &(_node->value);
 }
 
+//**********************************************************************************
+
+template <typename T>
+XorListForwardIterator<T>::XorListForwardIterator(XorListNode<T>* prev, XorListNode<T>* node):
+        _prev_node(prev), _node(node) {}
+
+template <typename T>
+XorListForwardIterator<T>& XorListForwardIterator<T>::operator++() {
+    auto next_node = get_next(_prev_node, _node);
+    _prev_node = _node;
+    _node = next_node;
+    return *this;
+}
+
+template <typename T>
+T& XorListForwardIterator<T>::operator*() const {
+    return _node->value;
+}
+
+template <typename T>
+T* XorListForwardIterator<T>::operator->() const {
+    return &(_node->value);
+}
+
+template <typename T>
+bool XorListForwardIterator<T>::operator==(const XorListForwardIterator<T>& other) const {
+    return _node == other._node;
+}
+
+template <typename T>
+bool XorListForwardIterator<T>::operator!=(const XorListForwardIterator<T>& other) const {
+    return _node != other._node;
+}
+
+template <typename T>
+XorListRange<T>::XorListRange(XorListNode<T>* first): _first(first) {}
+
+template <typename T>
+typename XorListRange<T>::iterator XorListRange<T>::begin() const {
+    return iterator(nullptr, _first);
+}
+
+template <typename T>
+typename XorListRange<T>::iterator XorListRange<T>::end() const {
+    return iterator(nullptr, nullptr);
+}
+
+//**********************************************************************************
+
+template <typename T, class Alloc>
+XorListNodeHandle<T, Alloc>::XorListNodeHandle() noexcept: _node(nullptr) {}
+
+template <typename T, class Alloc>
+XorListNodeHandle<T, Alloc>::XorListNodeHandle(XorListNode<T>* node, const AllocNode& alloc):
+        _node(node) {
+    new (&_alloc) AllocNode(alloc);
+}
+
+template <typename T, class Alloc>
+XorListNodeHandle<T, Alloc>::XorListNodeHandle(XorListNodeHandle<T, Alloc>&& other) noexcept:
+        _node(nullptr) {
+    *this = std::move(other);
+}
+
+template <typename T, class Alloc>
+XorListNodeHandle<T, Alloc>& XorListNodeHandle<T, Alloc>::operator=
+        (XorListNodeHandle<T, Alloc>&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+    reset();
+    if (other._node != nullptr) {
+        new (&_alloc) AllocNode(std::move(other.alloc()));
+        _node = other.release();
+    }
+    return *this;
+}
+
+template <typename T, class Alloc>
+XorListNodeHandle<T, Alloc>::~XorListNodeHandle() {
+    reset();
+}
+
+template <typename T, class Alloc>
+typename XorListNodeHandle<T, Alloc>::AllocNode& XorListNodeHandle<T, Alloc>::alloc() const {
+    return *reinterpret_cast<AllocNode*>(&_alloc);
+}
+
+template <typename T, class Alloc>
+XorListNode<T>* XorListNodeHandle<T, Alloc>::release() {
+    auto node = _node;
+    alloc().~AllocNode();
+    _node = nullptr;
+    return node;
+}
+
+template <typename T, class Alloc>
+void XorListNodeHandle<T, Alloc>::reset() {
+    if (_node == nullptr) {
+        return;
+    }
+    alloc().destroy(_node);
+    alloc().deallocate(_node, 1);
+    release();
+}
+
+template <typename T, class Alloc>
+bool XorListNodeHandle<T, Alloc>::empty() const {
+    return _node == nullptr;
+}
+
+template <typename T, class Alloc>
+XorListNodeHandle<T, Alloc>::operator bool() const {
+    return _node != nullptr;
+}
+
+template <typename T, class Alloc>
+T& XorListNodeHandle<T, Alloc>::value() const {
+    if (_node == nullptr)
+        throw YException("XorList: trying to get element from empty node handle");
+
+    return _node->value;
+}
+
+template <typename T, class Alloc>
+Alloc XorListNodeHandle<T, Alloc>::get_allocator() const {
+    if (_node == nullptr)
+        throw YException("XorList: trying to get allocator of empty node handle");
+
+    return Alloc(alloc());
+}
+
+//**********************************************************************************
+
 #if DEBUG
 template <typename T, class Alloc>
 bool XorListIterator<T, Alloc>::is_valid() const {
@@ -0,0 +1,116 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <type_traits>
+#include "smallfunctions.h"
+
+// Dump of a list of trivially copyable values: this header and then count
+// values back to back, first to last, in the byte order of the writer.
+struct XorListDumpHeader {
+    uint64_t magic;
+    uint64_t value_size;
+    uint64_t count;
+};
+
+constexpr uint64_t XOR_LIST_DUMP_MAGIC = 0x31504d55444c5258ULL;
+// Values are staged and read in blocks of this many bytes.
+constexpr size_t XOR_LIST_IO_BLOCK = 65536;
+
+// Writes a dump of count values taken one by one from first.
+template <typename T, class InputIt>
+void write_xor_list_dump(std::ostream& out, InputIt first, size_t count) {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "XorList dump: T must be trivially copyable");
+
+    XorListDumpHeader header = {XOR_LIST_DUMP_MAGIC, sizeof(T), count};
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    const size_t block = std::max((size_t)1, XOR_LIST_IO_BLOCK / sizeof(T));
+    std::unique_ptr<char[]> buffer(new char[block * sizeof(T)]);
+    size_t staged = 0;
+    for (size_t i = 0; i < count; ++i, ++first) {
+        memcpy(buffer.get() + staged * sizeof(T), &*first, sizeof(T));
+        if (++staged == block) {
+            out.write(buffer.get(), staged * sizeof(T));
+            staged = 0;
+        }
+    }
+    out.write(buffer.get(), staged * sizeof(T));
+
+    if (not out)
+        throw YException("XorList dump: write failed");
+}
+
+// Reads a dump block by block, so it never holds more than the caller asks.
+// The count comes from the stream; if the stream can seek, a count larger
+// than the rest of it could hold throws, else reading past its end does.
+template <typename T>
+class XorListDumpReader {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "XorList dump: T must be trivially copyable");
+public:
+    explicit XorListDumpReader(std::istream& in);
+
+    size_t size() const;
+    size_t remaining() const;
+
+    // Reads up to count values to out and returns how many were read,
+    // 0 at the end of the dump.
+    size_t read(T* out, size_t count);
+
+private:
+    std::istream& _in;
+    size_t _size;
+    size_t _remaining;
+};
+
+//=======================================================================================
+
+template <typename T>
+XorListDumpReader<T>::XorListDumpReader(std::istream& in):
+        _in(in) {
+    XorListDumpHeader header;
+    if (not _in.read(reinterpret_cast<char*>(&header), sizeof(header))
+            or header.magic != XOR_LIST_DUMP_MAGIC)
+        throw YException("XorList dump: stream doesn't hold a list dump");
+    if (header.value_size != sizeof(T))
+        throw YException("XorList dump: dump holds values of other type");
+    if (header.count > std::numeric_limits<size_t>::max() / sizeof(T))
+        throw YException("XorList dump: dump is damaged");
+
+    std::streampos start = _in.tellg();
+    if (start != std::streampos(-1)) {
+        _in.seekg(0, std::ios::end);
+        std::streampos end = _in.tellg();
+        _in.seekg(start);
+        if (end != std::streampos(-1) and (uint64_t)(end - start) / sizeof(T) < header.count)
+            throw YException("XorList dump: dump is cut short");
+    }
+
+    _size = _remaining = (size_t)header.count;
+}
+
+template <typename T>
+size_t XorListDumpReader<T>::size() const {
+    return _size;
+}
+
+template <typename T>
+size_t XorListDumpReader<T>::remaining() const {
+    return _remaining;
+}
+
+template <typename T>
+size_t XorListDumpReader<T>::read(T* out, size_t count) {
+    count = std::min(count, _remaining);
+    if (not _in.read(reinterpret_cast<char*>(out), count * sizeof(T)))
+        throw YException("XorList dump: dump is cut short");
+
+    _remaining -= count;
+    return count;
+}
@@ -1,5 +1,3 @@
-#include <iostream>
-#include <list>
 #include <gtest/gtest.h>
 #include "test.h"
 
@@ -7,11 +5,3 @@ int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();
 }
-
-/*
-int main() {
-    cout << time_test<int, XorList<int> >(1000000) << "\n";
-
-    cout << time_test<int, XorList<int, StackAllocator<int> > >(1000000) << "\n";
-}
-*/
@@ -0,0 +1,103 @@
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mapped_file.h"
+#include "smallfunctions.h"
+
+namespace {
+
+    YException file_error(const std::string& what, const std::string& path) {
+        return YException("MappedFile: " + what + " " + path + ": " + strerror(errno));
+    }
+
+}
+
+//------------------------------------------------------------------------------------
+
+MappedFile::MappedFile(const std::string& path):
+    _path(path),
+    _fd(-1),
+    _data(nullptr),
+    _size(0)
+{
+    _fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (_fd < 0) {
+        throw file_error("can't open", path);
+    }
+
+    struct stat info;
+    if (fstat(_fd, &info) != 0) {
+        close(_fd);
+        throw file_error("can't stat", path);
+    }
+    _size = (size_t)info.st_size;
+
+    try {
+        map();
+    }
+    catch (...) {
+        close(_fd);
+        throw;
+    }
+}
+
+MappedFile::~MappedFile() {
+    unmap();
+    close(_fd);
+}
+
+void MappedFile::map() {
+    if (_size == 0) {
+        return;
+    }
+    void* data = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (data == MAP_FAILED) {
+        throw file_error("can't map", _path);
+    }
+    _data = data;
+}
+
+void MappedFile::unmap() {
+    if (_data != nullptr) {
+        munmap(_data, _size);
+    }
+    _data = nullptr;
+}
+
+//------------------------------------------------------------------------------------
+
+void* MappedFile::data() const {
+    return _data;
+}
+
+size_t MappedFile::size() const {
+    return _size;
+}
+
+void MappedFile::resize(size_t size) {
+    if (ftruncate(_fd, (off_t)size) != 0) {
+        throw file_error("can't resize", _path);
+    }
+    unmap();
+    _size = size;
+    map();
+}
+
+// msync wants a page aligned start.
+void MappedFile::sync(size_t offset, size_t size) {
+    auto page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t start = offset / page_size * page_size;
+    if (msync(static_cast<char*>(_data) + start, offset + size - start, MS_SYNC) != 0) {
+        throw file_error("can't sync", _path);
+    }
+}
+
+void MappedFile::lock() {
+    if (flock(_fd, LOCK_EX | LOCK_NB) != 0) {
+        throw file_error("can't lock", _path);
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Read-write shared mapping of a whole file. The file is created empty if it
+// doesn't exist; an empty file is not mapped until it is resized.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void* data() const;
+    size_t size() const;
+
+    // The mapping may move, pointers into it must be taken again.
+    void resize(size_t size);
+    // Returns once the range is written to the disk.
+    void sync(size_t offset, size_t size);
+    // Exclusive advisory lock, held until the file is closed; throws
+    // YException if another MappedFile of the file holds it.
+    void lock();
+
+private:
+    void map();
+    void unmap();
+
+    std::string _path;
+    int _fd;
+    void* _data;
+    size_t _size;
+};
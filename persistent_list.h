@@ -0,0 +1,659 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include "mapped_file.h"
+#include "smallfunctions.h"
+
+template <typename T>
+class PersistentXorListIterator;
+
+// Links are XOR of byte offsets from the start of the file; offset 0 is the
+// header, so it stands for nullptr. Free slots keep the next free offset.
+template <typename T>
+struct PersistentXorNode {
+public:
+    T value;
+    uint64_t link;
+};
+
+// Start of every list file. The data after it is split in pages of
+// _PAGE_SIZE bytes; pages below extent hold the list as of the last sync()
+// and are covered by pages_checksum. Dirty is set before the first change
+// after sync() and cleared by the next sync(), which also starts a new epoch.
+struct PersistentXorListHeader {
+    uint64_t magic;
+    uint64_t node_size;
+    uint64_t used;
+    uint64_t free;
+    uint64_t first;
+    uint64_t last;
+    uint64_t size;
+    uint64_t extent;
+    uint64_t pages_checksum;
+    uint64_t epoch;
+    uint64_t dirty;
+    // Of the header without epoch, dirty and checksum.
+    uint64_t checksum;
+};
+
+// Journal record, followed by the page at offset as the last sync() left it.
+struct PersistentXorListSavedPage {
+    uint64_t epoch;
+    uint64_t offset;
+    uint64_t checksum;
+    uint64_t reserved;
+};
+
+// XorList kept in a memory mapped file, so a list written by one process is
+// opened by the next without allocating, linking or reading anything per
+// node. Only trivially copyable T may be stored.
+//
+// After sync() returns, the file holds the list as it was at that moment.
+// Before a page sync() left is changed for the first time, it is copied to
+// path.journal and the copy is synced; if the process dies with unsynced
+// changes, the next open copies the pages back, so the list is as of the
+// last sync() again. Appending past the last synced page needs no copies,
+// and sync() only writes and hashes the pages changed since the last one.
+// A list is opened by one PersistentXorList at a time.
+//
+// The destructor syncs. Elements are changed only through replace(), which
+// marks the file dirty like any other change. Growing the file may move the
+// mapping: references to elements are invalidated by inserts, iterators
+// are not.
+template <typename T>
+class PersistentXorList {
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "PersistentXorList: T must be trivially copyable");
+public:
+    // Opens the list stored in path or makes an empty one if there is none.
+    // Only the header is checked against its checksum unless check_pages,
+    // which reads the whole file, see verify().
+    explicit PersistentXorList(const std::string& path, bool check_pages = false);
+    ~PersistentXorList();
+
+    PersistentXorList(const PersistentXorList<T>&) = delete;
+    PersistentXorList<T>& operator=(const PersistentXorList<T>&) = delete;
+
+    friend class PersistentXorListIterator<T>;
+    typedef PersistentXorListIterator<T> iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+
+    size_t size() const;
+    bool empty() const;
+
+    const T& back();
+    const T& front();
+
+    void replace(iterator, const T&);
+    void push_back(const T&);
+    void push_front(const T&);
+    iterator insert_before(iterator, const T&);
+    iterator insert_after(iterator, const T&);
+
+    void pop_back();
+    void pop_front();
+    void erase(iterator);
+    void clear();
+
+    iterator begin();
+    iterator end();
+
+    void sync();
+    // Checks the whole file against the checksums of the last sync().
+    bool verify() const;
+
+private:
+    typedef PersistentXorNode<T> node;
+    typedef PersistentXorListHeader header;
+    typedef PersistentXorListSavedPage saved_page;
+
+    static constexpr uint64_t _MAGIC = 0x5453494c524f5832ULL;
+    static constexpr uint64_t _PAGE_SIZE = 4096;
+    // Header has a page to itself, so marking it dirty syncs one page.
+    static constexpr uint64_t _DATA_OFFSET = _PAGE_SIZE;
+    static constexpr size_t _MIN_FILE_SIZE = 65536;
+    static constexpr size_t _RECORD_SIZE = sizeof(saved_page) + _PAGE_SIZE;
+
+    header* head() const;
+    node& slot(uint64_t offset);
+    // slot() for writing: saves the pages under it first.
+    node& changed_slot(uint64_t offset);
+    char* page(uint64_t offset) const;
+    uint64_t header_checksum() const;
+    uint64_t page_checksum(const char* data, uint64_t offset) const;
+    uint64_t record_checksum(const saved_page* record) const;
+    void save_page(uint64_t offset);
+    void roll_back();
+    void mark_dirty();
+    uint64_t take_slot();
+    void free_slot(uint64_t offset);
+    iterator make_iterator(uint64_t prev, uint64_t cur);
+
+    MappedFile _file;
+    MappedFile _journal;
+    // Pages saved in this epoch, to their records in the journal.
+    std::unordered_map<uint64_t, uint64_t> _saved;
+    uint64_t _journal_used;
+#if DEBUG
+    uint _version;
+#endif
+};
+
+template <typename T>
+class PersistentXorListIterator : public std::iterator<std::bidirectional_iterator_tag, T, ptrdiff_t,
+                                                       const T*, const T&> {
+public:
+    friend class PersistentXorList<T>;
+
+    PersistentXorListIterator<T>& operator++();
+    const PersistentXorListIterator<T> operator++(int);
+    PersistentXorListIterator<T>& operator--();
+    const PersistentXorListIterator<T> operator--(int);
+    const T& operator*();
+    const T* operator->();
+
+    bool operator==(const PersistentXorListIterator<T>&) const;
+    bool operator!=(const PersistentXorListIterator<T>&) const;
+
+private:
+    PersistentXorList<T>* _list;
+    uint64_t _node;
+    uint64_t _prev_node;
+#if DEBUG
+    bool is_valid() const;
+    uint _version;
+#endif
+};
+
+//=======================================================================================
+//=======================================================================================
+
+template <typename T>
+PersistentXorList<T>::PersistentXorList(const std::string& path, bool check_pages):
+        _file(path),
+        _journal(path + ".journal"),
+        _journal_used(0) {
+#if DEBUG
+    _version = 0;
+#endif
+    _file.lock();
+    if (_file.size() == 0) {
+        _file.resize(_MIN_FILE_SIZE);
+        header* new_head = head();
+        new_head->magic = _MAGIC;
+        new_head->node_size = sizeof(node);
+        new_head->used = new_head->extent = _DATA_OFFSET;
+        new_head->free = new_head->first = new_head->last = 0;
+        new_head->size = new_head->pages_checksum = 0;
+        new_head->epoch = new_head->dirty = 0;
+        new_head->checksum = header_checksum();
+        _file.sync(0, sizeof(header));
+        return;
+    }
+
+    if (_file.size() < _DATA_OFFSET or head()->magic != _MAGIC)
+        throw YException("PersistentXorList: " + path + " is not a list file");
+    if (head()->node_size != sizeof(node))
+        throw YException("PersistentXorList: " + path + " holds elements of other type");
+    if (head()->dirty) {
+        roll_back();
+    }
+    if (head()->dirty)
+        throw YException("PersistentXorList: " + path + " was changed after the last sync and its journal is lost");
+    if (head()->checksum != header_checksum() or head()->used < _DATA_OFFSET or head()->used > head()->extent
+            or head()->extent > _file.size() or head()->extent % _PAGE_SIZE != 0 or (check_pages and not verify()))
+        throw YException("PersistentXorList: " + path + " doesn't match its checksum");
+}
+
+template <typename T>
+PersistentXorList<T>::~PersistentXorList() {
+    try {
+        sync();
+    }
+    catch (...) {
+        // File stays dirty, the next open rolls it back.
+    }
+}
+
+//----------------------------------------------------------------------
+
+template <typename T>
+PersistentXorListHeader* PersistentXorList<T>::head() const {
+    return static_cast<header*>(_file.data());
+}
+
+template <typename T>
+typename PersistentXorList<T>::node& PersistentXorList<T>::slot(uint64_t offset) {
+    return *reinterpret_cast<node*>(page(offset));
+}
+
+template <typename T>
+typename PersistentXorList<T>::node& PersistentXorList<T>::changed_slot(uint64_t offset) {
+    uint64_t last = std::min(offset + sizeof(node), head()->extent);
+    for (uint64_t at = offset / _PAGE_SIZE * _PAGE_SIZE; at < last; at += _PAGE_SIZE) {
+        save_page(at);
+    }
+    return slot(offset);
+}
+
+template <typename T>
+char* PersistentXorList<T>::page(uint64_t offset) const {
+    return static_cast<char*>(_file.data()) + offset;
+}
+
+template <typename T>
+uint64_t PersistentXorList<T>::header_checksum() const {
+    header copy = *head();
+    copy.epoch = copy.dirty = copy.checksum = 0;
+    return hash_bytes(&copy, sizeof(copy));
+}
+
+// Seeded with the offset, so that pages can't trade places unnoticed.
+template <typename T>
+uint64_t PersistentXorList<T>::page_checksum(const char* data, uint64_t offset) const {
+    return hash_bytes(data, _PAGE_SIZE, hash_bytes(&offset, sizeof(offset)));
+}
+
+template <typename T>
+uint64_t PersistentXorList<T>::record_checksum(const saved_page* record) const {
+    return hash_bytes(record + 1, _PAGE_SIZE, hash_bytes(record, offsetof(saved_page, checksum)));
+}
+
+// The copy is on disk before the page can change.
+template <typename T>
+void PersistentXorList<T>::save_page(uint64_t offset) {
+    if (_saved.count(offset) != 0) {
+        return;
+    }
+    if (_journal_used + _RECORD_SIZE > _journal.size()) {
+        _journal.resize(std::max(2 * _journal.size(), (size_t)_MIN_FILE_SIZE));
+    }
+    auto record = reinterpret_cast<saved_page*>(static_cast<char*>(_journal.data()) + _journal_used);
+    record->epoch = head()->epoch;
+    record->offset = offset;
+    memcpy(record + 1, page(offset), _PAGE_SIZE);
+    record->checksum = record_checksum(record);
+    record->reserved = 0;
+    _journal.sync(_journal_used, _RECORD_SIZE);
+    _saved[offset] = _journal_used;
+    _journal_used += _RECORD_SIZE;
+}
+
+// Copies back the pages saved in the epoch of the header, which is only
+// changed by sync(); the header goes last, so a crash here leaves the file
+// to be rolled back again.
+template <typename T>
+void PersistentXorList<T>::roll_back() {
+    uint64_t epoch = head()->epoch;
+    const saved_page* saved_head = nullptr;
+    for (uint64_t at = 0; at + _RECORD_SIZE <= _journal.size(); at += _RECORD_SIZE) {
+        auto record = reinterpret_cast<const saved_page*>(static_cast<char*>(_journal.data()) + at);
+        if (record->epoch != epoch or record->checksum != record_checksum(record)
+                or record->offset % _PAGE_SIZE != 0 or record->offset + _PAGE_SIZE > _file.size()) {
+            break;
+        }
+        if (record->offset == 0) {
+            saved_head = record;
+            continue;
+        }
+        memcpy(page(record->offset), record + 1, _PAGE_SIZE);
+        _file.sync(record->offset, _PAGE_SIZE);
+    }
+    if (saved_head != nullptr) {
+        memcpy(page(0), saved_head + 1, _PAGE_SIZE);
+        _file.sync(0, sizeof(header));
+    }
+}
+
+template <typename T>
+void PersistentXorList<T>::mark_dirty() {
+    if (not head()->dirty) {
+        save_page(0);
+        head()->dirty = 1;
+        _file.sync(0, sizeof(header));
+    }
+}
+
+// Data goes to disk before the header that makes it valid. Pages below the
+// old extent were saved before they changed; the ones above it are new.
+template <typename T>
+void PersistentXorList<T>::sync() {
+    if (not head()->dirty) {
+        return;
+    }
+    uint64_t old_extent = head()->extent;
+    uint64_t extent = std::max(old_extent, (head()->used + _PAGE_SIZE - 1) / _PAGE_SIZE * _PAGE_SIZE);
+    uint64_t pages_checksum = head()->pages_checksum;
+    for (const auto& saved : _saved) {
+        if (saved.first == 0) {
+            continue;
+        }
+        auto record = reinterpret_cast<const saved_page*>(static_cast<char*>(_journal.data()) + saved.second);
+        pages_checksum ^= page_checksum(reinterpret_cast<const char*>(record + 1), saved.first);
+        pages_checksum ^= page_checksum(page(saved.first), saved.first);
+        _file.sync(saved.first, _PAGE_SIZE);
+    }
+    for (uint64_t at = old_extent; at < extent; at += _PAGE_SIZE) {
+        pages_checksum ^= page_checksum(page(at), at);
+    }
+    _file.sync(old_extent, extent - old_extent);
+
+    head()->extent = extent;
+    head()->pages_checksum = pages_checksum;
+    head()->checksum = header_checksum();
+    head()->epoch++;
+    head()->dirty = 0;
+    _file.sync(0, sizeof(header));
+    _saved.clear();
+    _journal_used = 0;
+}
+
+template <typename T>
+bool PersistentXorList<T>::verify() const {
+    if (head()->dirty or head()->checksum != header_checksum()) {
+        return false;
+    }
+    uint64_t pages_checksum = 0;
+    for (uint64_t at = _DATA_OFFSET; at < head()->extent; at += _PAGE_SIZE) {
+        pages_checksum ^= page_checksum(page(at), at);
+    }
+    return pages_checksum == head()->pages_checksum;
+}
+
+template <typename T>
+uint64_t PersistentXorList<T>::take_slot() {
+    if (head()->free != 0) {
+        uint64_t result = head()->free;
+        head()->free = slot(result).link;
+        return result;
+    }
+    if (head()->used + sizeof(node) > _file.size()) {
+        _file.resize(2 * _file.size());
+    }
+    uint64_t result = head()->used;
+    head()->used += sizeof(node);
+    return result;
+}
+
+template <typename T>
+void PersistentXorList<T>::free_slot(uint64_t offset) {
+    changed_slot(offset).link = head()->free;
+    head()->free = offset;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T>
+typename PersistentXorList<T>::iterator PersistentXorList<T>::make_iterator
+        (uint64_t prev, uint64_t cur) {
+    iterator iter;
+    iter._list = this;
+    iter._node = cur;
+    iter._prev_node = prev;
+#if DEBUG
+    iter._version = _version;
+#endif
+    return iter;
+}
+
+template <typename T>
+typename PersistentXorList<T>::iterator PersistentXorList<T>::begin() {
+    return make_iterator(0, head()->first);
+}
+
+template <typename T>
+typename PersistentXorList<T>::iterator PersistentXorList<T>::end() {
+    return make_iterator(head()->last, 0);
+}
+
+template <typename T>
+size_t PersistentXorList<T>::size() const {
+    return head()->size;
+}
+
+template <typename T>
+bool PersistentXorList<T>::empty() const {
+    return head()->size == 0;
+}
+
+template <typename T>
+const T& PersistentXorList<T>::back() {
+    if (empty())
+        throw YException("PersistentXorList: trying to get elements from empty list");
+
+    return slot(head()->last).value;
+}
+
+template <typename T>
+const T& PersistentXorList<T>::front() {
+    if (empty())
+        throw YException("PersistentXorList: trying to get elements from empty list");
+
+    return slot(head()->first).value;
+}
+
+// Iterators stay valid.
+template <typename T>
+void PersistentXorList<T>::replace(iterator iter, const T& value) {
+#ifdef DEBUG
+    if (iter._node == 0)
+        throw YException("PersistentXorList: trying to replace element after last");
+    if (iter._version != this->_version)
+        throw YException("PersistentXorList: Iterator is invalid because the list has been changed");
+    if (iter._list != this)
+        throw YException("PersistentXorList: trying to use iterator from other list");
+#endif
+
+    T copy = value;
+    mark_dirty();
+    changed_slot(iter._node).value = copy;
+}
+
+//---------------------------------------------------------------------------
+
+template <typename T>
+typename PersistentXorList<T>::iterator PersistentXorList<T>::insert_before
+        (iterator iter, const T& value) {
+#ifdef DEBUG
+    if (iter._version != this->_version)
+        throw YException("PersistentXorList: Iterator is invalid because the list has been changed");
+    if (iter._list != this)
+        throw YException("PersistentXorList: trying to use iterator from other list");
+#endif
+
+    // value may be an element of this list, the file may move under it.
+    T copy = value;
+    mark_dirty();
+#if DEBUG
+    _version++;
+#endif
+    uint64_t added = take_slot();
+    node& added_node = changed_slot(added);
+    added_node.value = copy;
+    added_node.link = iter._prev_node ^ iter._node;
+
+    if (iter._node != 0) {
+        changed_slot(iter._node).link ^= added ^ iter._prev_node;
+    }
+    else {
+        head()->last = added;
+    }
+
+    if (iter._prev_node != 0) {
+        changed_slot(iter._prev_node).link ^= added ^ iter._node;
+    }
+    else {
+        head()->first = added;
+    }
+    iter._prev_node = added;
+
+    head()->size++;
+#if DEBUG
+    iter._version = _version;
+#endif
+    return iter;
+}
+
+template <typename T>
+typename PersistentXorList<T>::iterator PersistentXorList<T>::insert_after
+        (iterator iter, const T& value) {
+#ifdef DEBUG
+    if (iter == end())
+        throw YException("PersistentXorList: trying to insert after end iterator");
+#endif
+
+    ++iter;
+    iter = insert_before(iter, value);
+    --iter;
+    --iter;
+    return iter;
+}
+
+template <typename T>
+void PersistentXorList<T>::push_back(const T& value) {
+    insert_before(end(), value);
+}
+
+template <typename T>
+void PersistentXorList<T>::push_front(const T& value) {
+    insert_before(begin(), value);
+}
+
+//---------------------------------------------------------------------------
+
+template <typename T>
+void PersistentXorList<T>::erase(iterator iter) {
+#ifdef DEBUG
+    if (iter._node == 0)
+        throw YException("PersistentXorList: trying to erase element after last");
+    if (iter._version != this->_version)
+        throw YException("PersistentXorList: Iterator is invalid because the list has been changed");
+    if (iter._list != this)
+        throw YException("PersistentXorList: trying to use iterator from other list");
+#endif
+
+    mark_dirty();
+#if DEBUG
+    _version++;
+#endif
+    uint64_t next_node = iter._prev_node ^ slot(iter._node).link;
+
+    if (next_node != 0) {
+        changed_slot(next_node).link ^= iter._node ^ iter._prev_node;
+    }
+    else {
+        head()->last = iter._prev_node;
+    }
+
+    if (iter._prev_node != 0) {
+        changed_slot(iter._prev_node).link ^= iter._node ^ next_node;
+    }
+    else {
+        head()->first = next_node;
+    }
+
+    free_slot(iter._node);
+    head()->size--;
+}
+
+template <typename T>
+void PersistentXorList<T>::pop_back() {
+    auto it = end();
+    --it;
+    erase(it);
+}
+
+template <typename T>
+void PersistentXorList<T>::pop_front() {
+    erase(begin());
+}
+
+// The file keeps its size; new elements fill it from the start again.
+template <typename T>
+void PersistentXorList<T>::clear() {
+    mark_dirty();
+#if DEBUG
+    _version++;
+#endif
+    head()->used = _DATA_OFFSET;
+    head()->free = head()->first = head()->last = 0;
+    head()->size = 0;
+}
+
+//**********************************************************************************
+
+template <typename T>
+PersistentXorListIterator<T>& PersistentXorListIterator<T>::operator++() {
+#if DEBUG
+    if (!is_valid())
+        throw YException("PersistentXorList iterator: Iterator is invalid because the list has been changed");
+#endif
+
+    auto next_node = _prev_node ^ _list->slot(_node).link;
+    _prev_node = _node;
+    _node = next_node;
+    return *this;
+}
+
+template <typename T>
+PersistentXorListIterator<T>& PersistentXorListIterator<T>::operator--() {
+#if DEBUG
+    if (!is_valid())
+        throw YException("PersistentXorList iterator: Iterator is invalid because the list has been changed");
+#endif
+
+    auto very_prev_node = _node ^ _list->slot(_prev_node).link;
+    _node = _prev_node;
+    _prev_node = very_prev_node;
+    return *this;
+}
+
+template <typename T>
+const PersistentXorListIterator<T> PersistentXorListIterator<T>::operator++(int) {
+    auto result = *this;
+    operator++();
+    return result;
+}
+
+template <typename T>
+const PersistentXorListIterator<T> PersistentXorListIterator<T>::operator--(int) {
+    auto result = *this;
+    operator--();
+    return result;
+}
+
+//----------------------------------------------------------------------------------
+
+template <typename T>
+bool PersistentXorListIterator<T>::operator==(const PersistentXorListIterator<T>& other) const {
+    return _list == other._list and _node == other._node;
+}
+
+template <typename T>
+bool PersistentXorListIterator<T>::operator!=(const PersistentXorListIterator<T>& other) const {
+    return not (*this == other);
+}
+
+template <typename T>
+const T& PersistentXorListIterator<T>::operator*() {
+    return _list->slot(_node).value;
+}
+
+template <typename T>
+const T* PersistentXorListIterator<T>::operator->() {
+    return &_list->slot(_node).value;
+}
+
+#if DEBUG
+template <typename T>
+bool PersistentXorListIterator<T>::is_valid() const {
+    return _version == _list->_version;
+}
+#endif
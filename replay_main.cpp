@@ -0,0 +1,87 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <string>
+#include "allocator.h"
+#include "list.h"
+#include "trace.h"
+
+// Usage: XorList_replay TRACE
+//        XorList_replay --generate=N TRACE
+// Replays a trace of int operations, first checking XorList against
+// std::list, then timing every container. --generate writes a trace of N
+// random operations, positional ones included, to try it on.
+
+namespace {
+
+    struct Container {
+        const char* name;
+        ReplayResult (*replay)(TraceReader<int>&);
+    };
+
+    const Container CONTAINERS[] = {
+        {"XorList<std::allocator>", replay_trace<int, XorList<int> >},
+        {"XorList<StackAllocator>", replay_trace<int, XorList<int, StackAllocator<int> > >},
+        {"std::list", replay_trace<int, std::list<int> >},
+        {"std::deque", replay_trace<int, std::deque<int> >},
+    };
+
+    void usage(const char* program) {
+        fprintf(stderr, "usage: %s [--generate=N] TRACE\n", program);
+    }
+
+}
+
+int main(int argc, char** argv) {
+    size_t generate = 0;
+    std::string path;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--generate=", 11) == 0) {
+            generate = (size_t)strtod(argv[i] + 11, nullptr);
+        }
+        else if (path.empty() and argv[i][0] != '-') {
+            path = argv[i];
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (path.empty()) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    try {
+        if (generate != 0) {
+            TraceWriter<int> writer(path);
+            for (const auto& query : gen_queries<int>(generate)) {
+                writer.write(query);
+            }
+            writer.close();
+            printf("wrote %zu operations to %s\n", writer.count(), path.c_str());
+            return 0;
+        }
+
+        TraceReader<int> reader(path);
+        long long mismatch = verify_trace<int, XorList<int> >(reader);
+        if (mismatch >= 0) {
+            printf("XorList and std::list differ at operation %lld\n", mismatch);
+            return 1;
+        }
+
+        printf("%-28s %14s %14s %20s\n", "container", "operations", "Mops/s", "digest");
+        for (const auto& container : CONTAINERS) {
+            ReplayResult result = container.replay(reader);
+            printf("%-28s %14zu %14.2f %20llu\n", container.name, result.operations,
+                   result.ops_per_second() / 1e6, (unsigned long long)result.digest);
+        }
+    }
+    catch (const YException& error) {
+        fprintf(stderr, "%s\n", error.what());
+        return 1;
+    }
+    return 0;
+}
@@ -1,11 +1,20 @@
 #include "smallfunctions.h"
 
-void* increase_ptr(void* ptr, int delta) {
+void* increase_ptr(void* ptr, ptrdiff_t delta) {
 	return static_cast<void*>(static_cast<char*>(ptr) + delta);
 }
 
-int ptr_difference(void* p, void* q) {
-    return (int)(static_cast<char*>(p) - static_cast<char*>(q));
+ptrdiff_t ptr_difference(void* p, void* q) {
+    return static_cast<char*>(p) - static_cast<char*>(q);
+}
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+    auto bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = seed;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 1099511628211ULL;
+    }
+    return hash;
 }
 
 YException::YException(const std::string& str) noexcept :
@@ -1,4 +1,6 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <exception>
 
@@ -12,9 +14,12 @@ T div_ceil(T x, T y)  {
     }
 }
 
-void* increase_ptr(void* ptr, int delta);
+void* increase_ptr(void* ptr, ptrdiff_t delta);
 
-int ptr_difference(void* p, void* q);
+ptrdiff_t ptr_difference(void* p, void* q);
+
+// 64-bit FNV-1a, seed lets a hash be continued over several ranges.
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 14695981039346656037ULL);
 
 class YException : public std::exception {
 public:
@@ -24,6 +29,15 @@ private:
     std::string _str;
 };
 
+// Cache hint only: never faults, so nullptr and freed memory are fine.
+inline void prefetch(const void* ptr) {
+#if defined(__GNUC__)
+    __builtin_prefetch(ptr);
+#else
+    (void)ptr;
+#endif
+}
+
 template <typename T>
 T* xor_ptr(T* ptr1, T*ptr2) {
     return (T*)((long long)(ptr1) ^ (long long)(ptr2)); // NOLINT
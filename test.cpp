@@ -26,6 +26,21 @@ void print(QueryType q) {
         case BACK:
             cout << "back ";
             break;
+        case INSERT_AT:
+            cout << "insert at ";
+            break;
+        case ERASE_AT:
+            cout << "erase at ";
+            break;
+        case AT:
+            cout << "at ";
+            break;
+        case TRAVERSE:
+            cout << "traverse ";
+            break;
+        case SIZE:
+            cout << "size ";
+            break;
         default:
             cout << "We forgot some types";
     }
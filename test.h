@@ -4,6 +4,10 @@
 #include <iostream>
 #include <cstdio>
 #include <ctime>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <atomic>
 #include "allocator.h"
 #include "list.h"
 
@@ -11,8 +15,11 @@ using std::shared_ptr;
 using std::vector;
 using std::cout;
 
+// Simple queries touch only the ends, positional ones take an index.
 enum QueryType {PUSH_BACK = 0, POP_BACK, PUSH_FRONT, POP_FRONT, BACK,
-    FRONT, COUNT_OF_QUERY_TYPES};
+    FRONT, COUNT_OF_SIMPLE_QUERY_TYPES,
+    INSERT_AT = COUNT_OF_SIMPLE_QUERY_TYPES, ERASE_AT, AT, TRAVERSE, SIZE,
+    COUNT_OF_QUERY_TYPES};
 
 //-------------------------------------------------------------------
 
@@ -27,6 +34,13 @@ struct QueryInputDelete {};
 template <typename T>
 struct QueryInputGet {};
 
+// value is used by INSERT_AT only.
+template <typename T>
+struct QueryInputPosition {
+    size_t index;
+    T value;
+};
+
 template <typename T>
 struct QueryInput {
     QueryType type;
@@ -34,6 +48,7 @@ struct QueryInput {
         QueryInputAdd<T> add;
         QueryInputDelete<T> del;
         QueryInputGet<T> get;
+        QueryInputPosition<T> pos;
     };
 };
 
@@ -45,6 +60,12 @@ void print(QueryInput<T> query) {
     if (query.type == PUSH_BACK or query.type == PUSH_FRONT) {
         cout << query.add.value;
     }
+    else if (query.type == INSERT_AT) {
+        cout << query.pos.index << " " << query.pos.value;
+    }
+    else if (query.type == ERASE_AT or query.type == AT) {
+        cout << query.pos.index;
+    }
     cout << "\n";
 }
 
@@ -61,6 +82,13 @@ struct QueryOutputGet {
     T result;
 };
 
+// TRAVERSE hashes the bytes of every value, SIZE gives count alone.
+template <typename T>
+struct QueryOutputScan {
+    size_t count;
+    uint64_t digest;
+};
+
 template <typename T>
 struct QueryOutput {
     QueryType type;
@@ -68,6 +96,7 @@ struct QueryOutput {
         QueryOutputAdd<T> add;
         QueryOutputDelete<T> del;
         QueryOutputGet<T> get;
+        QueryOutputScan<T> scan;
     };
 
     bool operator==(const QueryOutput<T>& other) const;
@@ -76,9 +105,15 @@ struct QueryOutput {
 template <typename T>
 void print(QueryOutput<T> query) {
     print(query.type);
-    if (query.type == BACK or query.type == FRONT) {
+    if (query.type == BACK or query.type == FRONT or query.type == AT) {
         cout << query.get.result;
     }
+    else if (query.type == TRAVERSE) {
+        cout << query.scan.count << " " << query.scan.digest;
+    }
+    else if (query.type == SIZE) {
+        cout << query.scan.count;
+    }
     cout << "\n";
 }
 
@@ -97,9 +132,15 @@ bool QueryOutput<T>::operator==(const QueryOutput<T> &other) const {
     if (type != other.type) {
         return false;
     }
-    else if (type == BACK or type == FRONT) {
+    else if (type == BACK or type == FRONT or type == AT) {
         return get.result == other.get.result;
     }
+    else if (type == TRAVERSE) {
+        return scan.count == other.scan.count and scan.digest == other.scan.digest;
+    }
+    else if (type == SIZE) {
+        return scan.count == other.scan.count;
+    }
     else {
         return true;
     }
@@ -119,7 +160,21 @@ bool model_query(ModelList& model, QueryInput<T> query) {
         if (model.size == 0)
             return false;
     }
-    else {
+    else if (query.type == INSERT_AT) {
+        if (query.pos.index > model.size)
+            return false;
+        model.size++;
+    }
+    else if (query.type == ERASE_AT) {
+        if (query.pos.index >= model.size)
+            return false;
+        model.size--;
+    }
+    else if (query.type == AT) {
+        if (query.pos.index >= model.size)
+            return false;
+    }
+    else if (query.type != TRAVERSE and query.type != SIZE) {
         throw YException("model_query bug: unknown query types");
     }
     return true;
@@ -132,7 +187,7 @@ T random_value();
 
 template <typename T>
 QueryInput<T> random_simple_query() {
-    auto type = static_cast<QueryType >(rand() % COUNT_OF_QUERY_TYPES);
+    auto type = static_cast<QueryType >(rand() % COUNT_OF_SIMPLE_QUERY_TYPES);
     if (type == POP_FRONT or type == POP_BACK or type == BACK or type == FRONT) {
         QueryInput<T> result;
         result.type = type;
@@ -163,8 +218,84 @@ std::vector<QueryInput<T>> gen_simple_queries(size_t size) {
     return result;
 }
 
+// Indices are drawn up to twice the model size, so some are out of range
+// and get dropped by model_query.
+template <typename T>
+QueryInput<T> random_query(const ModelList& model) {
+    auto type = static_cast<QueryType >(rand() % COUNT_OF_QUERY_TYPES);
+    if (type < COUNT_OF_SIMPLE_QUERY_TYPES) {
+        return random_simple_query<T>();
+    }
+
+    QueryInput<T> result;
+    result.type = type;
+    result.pos.index = (size_t)rand() % (2 * model.size + 1);
+    result.pos.value = random_value<T>();
+    return result;
+}
+
+template <typename T>
+std::vector<QueryInput<T>> gen_queries(size_t size) {
+    vector<QueryInput<T>> result;
+    ModelList mlist;
+
+    while (result.size() < size) {
+        auto query = random_query<T>(mlist);
+        if (model_query(mlist, query)) {
+            result.push_back(query);
+        }
+    }
+    return result;
+}
+
 //--------------------------------------------------------------------
 
+// Walks from the nearer end; XorList finds the position itself, with its
+// finger cache when that is on.
+template <class List>
+typename List::iterator list_position(List& list, size_t index) {
+    if (index <= list.size() / 2) {
+        return std::next(list.begin(), index);
+    }
+    return std::prev(list.end(), list.size() - index);
+}
+
+template <typename T, class Alloc>
+typename XorList<T, Alloc>::iterator list_position(XorList<T, Alloc>& list, size_t index) {
+    return list.iterator_at(index);
+}
+
+// Picked for lists that have emplace(), the int argument makes it preferred.
+template <typename T, class List>
+auto do_positional_query(List& list, const QueryInput<T>& query, QueryOutput<T>& result, int)
+        -> decltype(list.emplace(list.begin(), query.pos.value), void()) {
+    if (query.type == INSERT_AT) {
+        list.emplace(list_position(list, query.pos.index), query.pos.value);
+    }
+    else if (query.type == ERASE_AT) {
+        list.erase(list_position(list, query.pos.index));
+    }
+    else if (query.type == AT) {
+        result.get.result = *list_position(list, query.pos.index);
+    }
+    else if (query.type == TRAVERSE) {
+        result.scan.count = 0;
+        result.scan.digest = hash_bytes(nullptr, 0);
+        for (const auto& value : list) {
+            result.scan.count++;
+            result.scan.digest = hash_bytes(&value, sizeof(value), result.scan.digest);
+        }
+    }
+    else if (query.type == SIZE) {
+        result.scan.count = list.size();
+    }
+}
+
+template <typename T, class List>
+void do_positional_query(List&, const QueryInput<T>&, QueryOutput<T>&, long) {
+    throw YException("From do_query: list has no positional operations\n");
+}
+
 template <typename T, class List>
 QueryOutput<T> do_query(List& list, QueryInput<T> query) {
     QueryOutput<T> result;
@@ -180,7 +311,7 @@ QueryOutput<T> do_query(List& list, QueryInput<T> query) {
         list.push_front(query.add.value);
     }
     else if (query.type == PUSH_BACK) {
-        list.push_front(query.add.value);
+        list.push_back(query.add.value);
     }
     else if (query.type == BACK) {
         result.get.result = list.back();
@@ -188,6 +319,9 @@ QueryOutput<T> do_query(List& list, QueryInput<T> query) {
     else if (query.type == FRONT) {
         result.get.result = list.front();
     }
+    else if (query.type < COUNT_OF_QUERY_TYPES) {
+        do_positional_query(list, query, result, 0);
+    }
     else {
         throw YException("From do_query: unknown type of query\n");
     }
@@ -237,3 +371,92 @@ bool check_is_equial(size_t count) {
     auto res2 = get_answers<T, List2>(queries);
     return res1 == res2;
 }
+
+template <typename T, class List1, class List2>
+bool check_positional_is_equial(size_t count) {
+    auto queries = gen_queries<T>(count);
+    auto res1 = get_answers<T, List1>(queries);
+    auto res2 = get_answers<T, List2>(queries);
+    return res1 == res2;
+}
+
+//----------------------------------------------------------------------
+
+// Any list with push_back/push_front/pop_front/pop_back behind one mutex,
+// to compare with ConcurrentXorList.
+template <typename T, class List>
+class MutexWrappedList {
+public:
+    template <typename U>
+    void push_back(U&& value) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _list.push_back(std::forward<U>(value));
+    }
+
+    template <typename U>
+    void push_front(U&& value) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _list.push_front(std::forward<U>(value));
+    }
+
+    bool try_pop_front(T& result) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_list.size() == 0)
+            return false;
+        result = std::move(_list.front());
+        _list.pop_front();
+        return true;
+    }
+
+    bool try_pop_back(T& result) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_list.size() == 0)
+            return false;
+        result = std::move(_list.back());
+        _list.pop_back();
+        return true;
+    }
+
+private:
+    std::mutex _mutex;
+    List _list;
+};
+
+// Half of the threads push_back count values each, the other half pop them
+// from the front. Returns wall time in seconds.
+template <typename T, class Deque>
+double contention_test(size_t threads, size_t count) {
+    Deque deque;
+    size_t producers = std::max((size_t)1, threads / 2);
+    size_t consumers = std::max((size_t)1, threads - producers);
+    std::atomic<size_t> consumed(0);
+    vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < producers; ++i) {
+        workers.emplace_back([&deque, count]() {
+            for (size_t j = 0; j < count; ++j) {
+                deque.push_back(static_cast<T>(j));
+            }
+        });
+    }
+    for (size_t i = 0; i < consumers; ++i) {
+        workers.emplace_back([&deque, &consumed, producers, count]() {
+            T value;
+            while (consumed.load() < producers * count) {
+                if (deque.try_pop_front(value)) {
+                    consumed++;
+                }
+                else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    auto finish = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(finish - start).count();
+}
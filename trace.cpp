@@ -0,0 +1,82 @@
+#include <cstring>
+#include <unistd.h>
+#include "trace.h"
+
+namespace {
+
+    const char TRACE_MAGIC[8] = {'X', 'L', 'T', 'R', 'A', 'C', 'E', '\0'};
+    const uint32_t TRACE_VERSION = 1;
+
+}
+
+//------------------------------------------------------------------------------------
+
+TraceHeader make_trace_header(size_t value_size) {
+    TraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.value_size = (uint32_t)value_size;
+    header.count = 0;
+    return header;
+}
+
+// MappedFile would create the file.
+const std::string& existing_trace(const std::string& path) {
+    if (access(path.c_str(), R_OK) != 0)
+        throw YException("TraceReader: can't open " + path);
+    return path;
+}
+
+void check_trace_header(const TraceHeader& header, size_t value_size) {
+    if (memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0)
+        throw YException("TraceReader: not a trace");
+    if (header.version != TRACE_VERSION)
+        throw YException("TraceReader: unsupported trace version " + std::to_string(header.version));
+    if (header.value_size != value_size)
+        throw YException("TraceReader: trace holds values of " + std::to_string(header.value_size)
+                         + " bytes, not " + std::to_string(value_size));
+}
+
+bool query_has_index(QueryType type) {
+    return type == INSERT_AT or type == ERASE_AT or type == AT;
+}
+
+bool query_has_value(QueryType type) {
+    return type == PUSH_BACK or type == PUSH_FRONT or type == INSERT_AT;
+}
+
+//------------------------------------------------------------------------------------
+
+size_t encode_index(uint64_t index, unsigned char* out) {
+    size_t size = 0;
+    while (index >= 0x80) {
+        out[size++] = (unsigned char)(index | 0x80);
+        index >>= 7;
+    }
+    out[size++] = (unsigned char)index;
+    return size;
+}
+
+bool decode_index(const unsigned char*& data, const unsigned char* end, uint64_t& index) {
+    index = 0;
+    for (size_t shift = 0; data != end and shift < 7 * MAX_INDEX_SIZE; shift += 7) {
+        unsigned char byte = *data++;
+        index |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------------
+
+ReplayResult::ReplayResult():
+    operations(0),
+    seconds(0),
+    digest(0)
+{}
+
+double ReplayResult::ops_per_second() const {
+    return seconds > 0 ? operations / seconds : 0;
+}
@@ -0,0 +1,416 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <list>
+#include <string>
+#include <type_traits>
+#include "mapped_file.h"
+#include "test.h"
+
+// Trace file: TraceHeader, then one record per operation: the QueryType in
+// one byte, the index as LEB128 for positional operations and the bytes of
+// the value for operations that add one.
+struct TraceHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t value_size;
+    // Written when the recorder is closed; 0 for a trace cut short, which
+    // is then read up to its last whole record.
+    uint64_t count;
+};
+
+TraceHeader make_trace_header(size_t value_size);
+// Returns path, or throws YException if there is no such file.
+const std::string& existing_trace(const std::string& path);
+// Throws YException if the header isn't one of a trace of such values.
+void check_trace_header(const TraceHeader& header, size_t value_size);
+
+bool query_has_index(QueryType);
+bool query_has_value(QueryType);
+
+// Returns the number of bytes written, at most MAX_INDEX_SIZE.
+const size_t MAX_INDEX_SIZE = 10;
+size_t encode_index(uint64_t index, unsigned char* out);
+// Advances data past the index; false if the index runs past end.
+bool decode_index(const unsigned char*& data, const unsigned char* end, uint64_t& index);
+
+template <typename T>
+uint64_t output_digest(const QueryOutput<T>& output, uint64_t seed);
+
+//-------------------------------------------------------------------------------------
+
+template <typename T>
+class TraceWriter {
+public:
+    explicit TraceWriter(const std::string& path);
+    // Closes the trace; errors are lost, call close() to see them.
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter<T>&) = delete;
+    TraceWriter<T>& operator=(const TraceWriter<T>&) = delete;
+
+    void write(const QueryInput<T>& query);
+    // Writes the count to the header and flushes the file.
+    void close();
+    size_t count() const;
+
+private:
+    std::ofstream _out;
+    size_t _count;
+    bool _closed;
+};
+
+// Reads a trace through a memory mapping, decoding records one by one.
+template <typename T>
+class TraceReader {
+public:
+    explicit TraceReader(const std::string& path);
+
+    TraceReader(const TraceReader<T>&) = delete;
+    TraceReader<T>& operator=(const TraceReader<T>&) = delete;
+
+    // 0 if the trace wasn't closed.
+    size_t size() const;
+    // false at the end of the trace; throws YException for unknown records.
+    bool next(QueryInput<T>& query);
+    void rewind();
+
+private:
+    MappedFile _file;
+    const unsigned char* _begin;
+    const unsigned char* _cur;
+    const unsigned char* _end;
+    size_t _count;
+};
+
+// A list whose every operation is logged to a trace before it is done.
+// All but for_each() go through do_query(), as they will in a replay.
+template <typename T, class List = XorList<T> >
+class TraceRecorder {
+public:
+    TraceRecorder(List& list, const std::string& path);
+
+    void push_back(const T& value);
+    void push_front(const T& value);
+    void pop_back();
+    void pop_front();
+    T back();
+    T front();
+
+    void insert_at(size_t index, const T& value);
+    void erase_at(size_t index);
+    T at(size_t index);
+    template <class Function> void for_each(Function f);
+    size_t size();
+
+    TraceWriter<T>& writer();
+
+private:
+    QueryOutput<T> record(const QueryInput<T>& query);
+    QueryInput<T> make_query(QueryType type);
+
+    List& _list;
+    TraceWriter<T> _writer;
+};
+
+struct ReplayResult {
+    size_t operations;
+    double seconds;
+    // Hash of all query outputs, equal for lists that agree.
+    uint64_t digest;
+
+    ReplayResult();
+    double ops_per_second() const;
+};
+
+// Replays the trace from its start into an empty List as fast as records
+// are decoded; the trace must be valid, see verify_trace().
+template <typename T, class List>
+ReplayResult replay_trace(TraceReader<T>& reader);
+
+// Replays the trace into List and std::list side by side. Returns the
+// number of the first operation they answer differently, or -1. Throws
+// YException at an operation the list can't do, like a pop when empty.
+template <typename T, class List>
+long long verify_trace(TraceReader<T>& reader);
+
+//=======================================================================================
+//=======================================================================================
+
+template <typename T>
+uint64_t output_digest(const QueryOutput<T>& output, uint64_t seed) {
+    uint64_t digest = hash_bytes(&output.type, sizeof(output.type), seed);
+    if (output.type == BACK or output.type == FRONT or output.type == AT) {
+        digest = hash_bytes(&output.get.result, sizeof(T), digest);
+    }
+    else if (output.type == TRAVERSE) {
+        digest = hash_bytes(&output.scan, sizeof(output.scan), digest);
+    }
+    else if (output.type == SIZE) {
+        digest = hash_bytes(&output.scan.count, sizeof(output.scan.count), digest);
+    }
+    return digest;
+}
+
+//-------------------------------------------------------------------------------------
+
+template <typename T>
+TraceWriter<T>::TraceWriter(const std::string& path):
+        _out(path, std::ios::binary | std::ios::trunc),
+        _count(0),
+        _closed(false) {
+    static_assert(std::is_trivially_copyable<T>::value, "TraceWriter: T must be trivially copyable");
+    if (not _out)
+        throw YException("TraceWriter: can't open " + path);
+
+    TraceHeader header = make_trace_header(sizeof(T));
+    _out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+}
+
+template <typename T>
+TraceWriter<T>::~TraceWriter() {
+    try {
+        close();
+    }
+    catch (...) {}
+}
+
+template <typename T>
+void TraceWriter<T>::write(const QueryInput<T>& query) {
+    if (_closed)
+        throw YException("TraceWriter: writing to closed trace");
+
+    unsigned char record[1 + MAX_INDEX_SIZE + sizeof(T)];
+    size_t size = 0;
+    record[size++] = (unsigned char)query.type;
+    if (query_has_index(query.type)) {
+        size += encode_index(query.pos.index, record + size);
+    }
+    if (query_has_value(query.type)) {
+        const T& value = query.type == INSERT_AT ? query.pos.value : query.add.value;
+        memcpy(record + size, &value, sizeof(T));
+        size += sizeof(T);
+    }
+    _out.write(reinterpret_cast<const char*>(record), size);
+    _count++;
+}
+
+template <typename T>
+void TraceWriter<T>::close() {
+    if (_closed) {
+        return;
+    }
+    _closed = true;
+
+    uint64_t count = _count;
+    _out.seekp(offsetof(TraceHeader, count));
+    _out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    _out.flush();
+    if (not _out)
+        throw YException("TraceWriter: can't write trace");
+}
+
+template <typename T>
+size_t TraceWriter<T>::count() const {
+    return _count;
+}
+
+//-------------------------------------------------------------------------------------
+
+template <typename T>
+TraceReader<T>::TraceReader(const std::string& path):
+        _file(existing_trace(path)),
+        _begin(nullptr), _cur(nullptr), _end(nullptr),
+        _count(0) {
+    static_assert(std::is_trivially_copyable<T>::value, "TraceReader: T must be trivially copyable");
+    if (_file.size() < sizeof(TraceHeader))
+        throw YException("TraceReader: " + path + " is not a trace");
+
+    TraceHeader header;
+    memcpy(&header, _file.data(), sizeof(header));
+    check_trace_header(header, sizeof(T));
+
+    _count = (size_t)header.count;
+    _begin = static_cast<const unsigned char*>(_file.data()) + sizeof(header);
+    _end = static_cast<const unsigned char*>(_file.data()) + _file.size();
+    _cur = _begin;
+}
+
+template <typename T>
+size_t TraceReader<T>::size() const {
+    return _count;
+}
+
+template <typename T>
+void TraceReader<T>::rewind() {
+    _cur = _begin;
+}
+
+template <typename T>
+bool TraceReader<T>::next(QueryInput<T>& query) {
+    const unsigned char* data = _cur;
+    if (data == _end) {
+        return false;
+    }
+
+    if (*data >= COUNT_OF_QUERY_TYPES)
+        throw YException("TraceReader: unknown operation in trace");
+    query.type = static_cast<QueryType>(*data++);
+
+    if (query_has_index(query.type)) {
+        uint64_t index;
+        if (not decode_index(data, _end, index)) {
+            return false;
+        }
+        query.pos.index = (size_t)index;
+    }
+    if (query_has_value(query.type)) {
+        if ((size_t)(_end - data) < sizeof(T)) {
+            return false;
+        }
+        T& value = query.type == INSERT_AT ? query.pos.value : query.add.value;
+        memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+    }
+    _cur = data;
+    return true;
+}
+
+//-------------------------------------------------------------------------------------
+
+template <typename T, class List>
+TraceRecorder<T, List>::TraceRecorder(List& list, const std::string& path):
+        _list(list),
+        _writer(path) {}
+
+template <typename T, class List>
+QueryInput<T> TraceRecorder<T, List>::make_query(QueryType type) {
+    QueryInput<T> query;
+    query.type = type;
+    return query;
+}
+
+template <typename T, class List>
+QueryOutput<T> TraceRecorder<T, List>::record(const QueryInput<T>& query) {
+    _writer.write(query);
+    return do_query(_list, query);
+}
+
+template <typename T, class List>
+void TraceRecorder<T, List>::push_back(const T& value) {
+    auto query = make_query(PUSH_BACK);
+    query.add.value = value;
+    record(query);
+}
+
+template <typename T, class List>
+void TraceRecorder<T, List>::push_front(const T& value) {
+    auto query = make_query(PUSH_FRONT);
+    query.add.value = value;
+    record(query);
+}
+
+template <typename T, class List>
+void TraceRecorder<T, List>::pop_back() {
+    record(make_query(POP_BACK));
+}
+
+template <typename T, class List>
+void TraceRecorder<T, List>::pop_front() {
+    record(make_query(POP_FRONT));
+}
+
+template <typename T, class List>
+T TraceRecorder<T, List>::back() {
+    return record(make_query(BACK)).get.result;
+}
+
+template <typename T, class List>
+T TraceRecorder<T, List>::front() {
+    return record(make_query(FRONT)).get.result;
+}
+
+template <typename T, class List>
+void TraceRecorder<T, List>::insert_at(size_t index, const T& value) {
+    auto query = make_query(INSERT_AT);
+    query.pos.index = index;
+    query.pos.value = value;
+    record(query);
+}
+
+template <typename T, class List>
+void TraceRecorder<T, List>::erase_at(size_t index) {
+    auto query = make_query(ERASE_AT);
+    query.pos.index = index;
+    record(query);
+}
+
+template <typename T, class List>
+T TraceRecorder<T, List>::at(size_t index) {
+    auto query = make_query(AT);
+    query.pos.index = index;
+    return record(query).get.result;
+}
+
+template <typename T, class List>
+template <class Function>
+void TraceRecorder<T, List>::for_each(Function f) {
+    _writer.write(make_query(TRAVERSE));
+    for (auto& value : _list) {
+        f(value);
+    }
+}
+
+template <typename T, class List>
+size_t TraceRecorder<T, List>::size() {
+    return record(make_query(SIZE)).scan.count;
+}
+
+template <typename T, class List>
+TraceWriter<T>& TraceRecorder<T, List>::writer() {
+    return _writer;
+}
+
+//-------------------------------------------------------------------------------------
+
+template <typename T, class List>
+ReplayResult replay_trace(TraceReader<T>& reader) {
+    ReplayResult result;
+    result.digest = hash_bytes(nullptr, 0);
+    reader.rewind();
+    QueryInput<T> query;
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        List list;
+        while (reader.next(query)) {
+            result.digest = output_digest(do_query(list, query), result.digest);
+            result.operations++;
+        }
+    }
+    auto finish = std::chrono::steady_clock::now();
+
+    result.seconds = std::chrono::duration<double>(finish - start).count();
+    return result;
+}
+
+template <typename T, class List>
+long long verify_trace(TraceReader<T>& reader) {
+    reader.rewind();
+    List list;
+    std::list<T> model_list;
+    ModelList model;
+    QueryInput<T> query;
+
+    for (long long i = 0; reader.next(query); ++i) {
+        if (not model_query(model, query))
+            throw YException("verify_trace: operation " + std::to_string(i) + " is invalid");
+        if (not (do_query(list, query) == do_query(model_list, query))) {
+            return i;
+        }
+    }
+    return -1;
+}
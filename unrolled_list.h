@@ -0,0 +1,566 @@
+#pragma once
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include "smallfunctions.h"
+
+template <typename T, size_t N, class Alloc>
+class XorUnrolledListIterator;
+
+template <typename T, size_t N>
+struct XorUnrolledNode {
+public:
+    XorUnrolledNode* ptr;
+    size_t count;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type values[N];
+
+    XorUnrolledNode(): ptr(nullptr), count(0) {}
+
+    T& value(size_t i) {
+        return *reinterpret_cast<T*>(&values[i]);
+    }
+};
+
+// Same interface as XorList, but every node keeps up to N values in place,
+// so a traversal touches one link per N elements.
+template <typename T, size_t N = 8, class Alloc = std::allocator<T> >
+class XorUnrolledList {
+    static_assert(N >= 2, "XorUnrolledList: node must hold at least two values");
+public:
+    explicit XorUnrolledList(const Alloc& alloc = Alloc());
+    explicit XorUnrolledList(size_t count, const T& value = T(), const Alloc& alloc = Alloc());
+
+    XorUnrolledList(const XorUnrolledList<T, N, Alloc>&);
+    XorUnrolledList(XorUnrolledList<T, N, Alloc>&&) noexcept;
+    ~XorUnrolledList();
+
+    XorUnrolledList<T, N, Alloc>& operator=(const XorUnrolledList<T, N, Alloc>&);
+    XorUnrolledList<T, N, Alloc>& operator=(XorUnrolledList<T, N, Alloc>&&) noexcept;
+
+    friend class XorUnrolledListIterator<T, N, Alloc>;
+    typedef XorUnrolledListIterator<T, N, Alloc> iterator;
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+
+    size_t size() const;
+
+    T& back();
+    T& front();
+
+    template <typename U> void push_back(U&&);
+    template <typename U> void push_front(U&&);
+    template <typename U> iterator insert_before(iterator, U&&);
+    template <typename U> iterator insert_after(iterator, U&&);
+
+    void pop_back();
+    void pop_front();
+    iterator erase(iterator);
+
+    iterator begin();
+    iterator end();
+
+private:
+    typedef XorUnrolledNode<T, N> node;
+
+    node* new_node();
+    void free_node(node*);
+    void delete_nodes();
+    void link_node(node* prev, node* next, node* new_node);
+    void unlink_node(node* prev, node* old_node, node* next);
+    void move_value(node* from, size_t from_index, node* to, size_t to_index);
+    iterator make_iterator(node* prev, node* cur, size_t index);
+
+    typedef typename Alloc::template rebind<node>::other AllocNode;
+    AllocNode _alloc;
+    node* _first;
+    node* _last;
+    size_t _size;
+#if DEBUG
+    uint _version;
+#endif
+};
+
+template <typename T, size_t N, class Alloc>
+class XorUnrolledListIterator : public std::iterator<std::bidirectional_iterator_tag, T> {
+public:
+    friend class XorUnrolledList<T, N, Alloc>;
+
+    XorUnrolledListIterator<T, N, Alloc>& operator++();
+    const XorUnrolledListIterator<T, N, Alloc> operator++(int);
+    XorUnrolledListIterator<T, N, Alloc>& operator--();
+    const XorUnrolledListIterator<T, N, Alloc> operator--(int);
+    T& operator*();
+    T* operator->();
+
+    bool operator==(const XorUnrolledListIterator<T, N, Alloc>&) const;
+    bool operator!=(const XorUnrolledListIterator<T, N, Alloc>&) const;
+
+private:
+    XorUnrolledList<T, N, Alloc>* _list;
+    XorUnrolledNode<T, N>* _node;
+    XorUnrolledNode<T, N>* _prev_node;
+    size_t _index;
+#if DEBUG
+    bool is_valid() const;
+    uint _version;
+#endif
+};
+
+//=======================================================================================
+//=======================================================================================
+
+template <typename T, size_t N, class Alloc>
+XorUnrolledList<T, N, Alloc>::XorUnrolledList(const Alloc& alloc):
+        _alloc(alloc),
+        _first(nullptr), _last(nullptr),
+        _size(0) {
+#if DEBUG
+    _version = 0;
+#endif
+}
+
+template <typename T, size_t N, class Alloc>
+XorUnrolledList<T, N, Alloc>::XorUnrolledList(size_t count, const T& value,
+                                              const Alloc& alloc): XorUnrolledList(alloc) {
+    for (size_t i = 0; i < count; ++i) {
+        push_back(value);
+    }
+}
+
+template <typename T, size_t N, class Alloc>
+XorUnrolledList<T, N, Alloc>::XorUnrolledList(const XorUnrolledList<T, N, Alloc>& other):
+        XorUnrolledList(other._alloc) {
+    auto other_ptr = const_cast<XorUnrolledList<T, N, Alloc>*>(&other);
+    for (auto it = other_ptr->begin(); it != other_ptr->end(); ++it) {
+        push_back(*it);
+    }
+}
+
+template <typename T, size_t N, class Alloc>
+XorUnrolledList<T, N, Alloc>::XorUnrolledList(XorUnrolledList<T, N, Alloc>&& other) noexcept:
+        _alloc(other._alloc),
+        _first(other._first), _last(other._last),
+        _size(other._size) {
+#if DEBUG
+    _version = 0;
+#endif
+    other._first = other._last = nullptr;
+    other._size = 0;
+}
+
+template <typename T, size_t N, class Alloc>
+XorUnrolledList<T, N, Alloc>::~XorUnrolledList() {
+    delete_nodes();
+}
+
+template <typename T, size_t N, class Alloc>
+XorUnrolledList<T, N, Alloc>& XorUnrolledList<T, N, Alloc>::operator=
+        (const XorUnrolledList<T, N, Alloc>& other) {
+    if (this == &other) {
+        return *this;
+    }
+    delete_nodes();
+    _first = _last = nullptr;
+    _size = 0;
+#if DEBUG
+    _version++;
+#endif
+    auto other_ptr = const_cast<XorUnrolledList<T, N, Alloc>*>(&other);
+    for (auto it = other_ptr->begin(); it != other_ptr->end(); ++it) {
+        push_back(*it);
+    }
+    return *this;
+}
+
+template <typename T, size_t N, class Alloc>
+XorUnrolledList<T, N, Alloc>& XorUnrolledList<T, N, Alloc>::operator=
+        (XorUnrolledList<T, N, Alloc>&& other) noexcept {
+    if (this == &other) {
+        return *this;
+    }
+    delete_nodes();
+    _alloc = other._alloc;
+    _first = other._first;
+    _last = other._last;
+    _size = other._size;
+#if DEBUG
+    _version++;
+#endif
+
+    other._size = 0;
+    other._first = other._last = nullptr;
+    return *this;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, size_t N, class Alloc>
+typename XorUnrolledList<T, N, Alloc>::node* XorUnrolledList<T, N, Alloc>::new_node() {
+    node* result = _alloc.allocate(1);
+    _alloc.construct(result);
+    return result;
+}
+
+template <typename T, size_t N, class Alloc>
+void XorUnrolledList<T, N, Alloc>::free_node(node* old_node) {
+    for (size_t i = 0; i < old_node->count; ++i) {
+        old_node->value(i).~T();
+    }
+    _alloc.destroy(old_node);
+    _alloc.deallocate(old_node, 1);
+}
+
+template <typename T, size_t N, class Alloc>
+void XorUnrolledList<T, N, Alloc>::delete_nodes() {
+    node* first = nullptr;
+    node* second = _first;
+
+    while (second != nullptr) {
+        node* next_node = xor_ptr(first, second->ptr);
+        first = second;
+        second = next_node;
+        free_node(first);
+    }
+}
+
+template <typename T, size_t N, class Alloc>
+void XorUnrolledList<T, N, Alloc>::link_node(node* prev, node* next, node* new_node) {
+    new_node->ptr = xor_ptr(prev, next);
+
+    if (prev != nullptr) {
+        prev->ptr = xor_ptr(prev->ptr, next, new_node);
+    }
+    else {
+        _first = new_node;
+    }
+
+    if (next != nullptr) {
+        next->ptr = xor_ptr(next->ptr, prev, new_node);
+    }
+    else {
+        _last = new_node;
+    }
+}
+
+template <typename T, size_t N, class Alloc>
+void XorUnrolledList<T, N, Alloc>::unlink_node(node* prev, node* old_node, node* next) {
+    if (prev != nullptr) {
+        prev->ptr = xor_ptr(prev->ptr, old_node, next);
+    }
+    else {
+        _first = next;
+    }
+
+    if (next != nullptr) {
+        next->ptr = xor_ptr(next->ptr, old_node, prev);
+    }
+    else {
+        _last = prev;
+    }
+}
+
+template <typename T, size_t N, class Alloc>
+void XorUnrolledList<T, N, Alloc>::move_value(node* from, size_t from_index,
+                                              node* to, size_t to_index) {
+    ::new((void*)&to->values[to_index]) T(std::move(from->value(from_index)));
+    from->value(from_index).~T();
+}
+
+// Normalizes a position that fell off the end of a node onto the next one.
+template <typename T, size_t N, class Alloc>
+typename XorUnrolledList<T, N, Alloc>::iterator XorUnrolledList<T, N, Alloc>::make_iterator
+        (node* prev, node* cur, size_t index) {
+    if (cur != nullptr and index == cur->count) {
+        node* next = xor_ptr(prev, cur->ptr);
+        prev = cur;
+        cur = next;
+        index = 0;
+    }
+
+    iterator iter;
+    iter._list = this;
+    iter._node = cur;
+    iter._prev_node = prev;
+    iter._index = index;
+#if DEBUG
+    iter._version = _version;
+#endif
+    return iter;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, size_t N, class Alloc>
+typename XorUnrolledList<T, N, Alloc>::iterator XorUnrolledList<T, N, Alloc>::begin() {
+    return make_iterator(nullptr, _first, 0);
+}
+
+template <typename T, size_t N, class Alloc>
+typename XorUnrolledList<T, N, Alloc>::iterator XorUnrolledList<T, N, Alloc>::end() {
+    return make_iterator(_last, nullptr, 0);
+}
+
+template <typename T, size_t N, class Alloc>
+size_t XorUnrolledList<T, N, Alloc>::size() const {
+    return _size;
+}
+
+//---------------------------------------------------------------------------
+
+template <typename T, size_t N, class Alloc>
+template <typename U>
+typename XorUnrolledList<T, N, Alloc>::iterator XorUnrolledList<T, N, Alloc>::insert_before
+        (iterator iter, U&& value) {
+#ifdef DEBUG
+    if (iter._version != this->_version)
+        throw YException("XorUnrolledList: Iterator is invalid because the list has been changed");
+    if (iter._list != this)
+        throw YException("XorUnrolledList: trying to use iterator from other list");
+#endif
+
+    // value may be an element of this list, which the shift below moves.
+    T tmp(std::forward<U>(value));
+    node* prev;
+    node* target;
+    size_t pos;
+
+    if (_first == nullptr) {
+        target = new_node();
+        link_node(nullptr, nullptr, target);
+        prev = nullptr;
+        pos = 0;
+    }
+    else if (iter._node == nullptr) {
+        target = _last;
+        prev = _last->ptr;
+        pos = _last->count;
+    }
+    else {
+        target = iter._node;
+        prev = iter._prev_node;
+        pos = iter._index;
+    }
+
+    if (target->count == N) {
+        node* next = xor_ptr(prev, target->ptr);
+        node* half = new_node();
+        size_t keep = N / 2;
+        for (size_t i = keep; i < N; ++i) {
+            move_value(target, i, half, i - keep);
+        }
+        half->count = N - keep;
+        target->count = keep;
+        link_node(target, next, half);
+
+        if (pos > keep) {
+            prev = target;
+            target = half;
+            pos -= keep;
+        }
+    }
+
+    for (size_t i = target->count; i > pos; --i) {
+        move_value(target, i - 1, target, i);
+    }
+    ::new((void*)&target->values[pos]) T(std::move(tmp));
+    target->count++;
+
+    _size++;
+#if DEBUG
+    _version++;
+#endif
+    return make_iterator(prev, target, pos + 1);
+}
+
+template <typename T, size_t N, class Alloc>
+template <typename U>
+typename XorUnrolledList<T, N, Alloc>::iterator XorUnrolledList<T, N, Alloc>::insert_after
+        (iterator iter, U&& value) {
+#ifdef DEBUG
+    if (iter == end())
+        throw YException("XorUnrolledList: trying to insert after end iterator");
+#endif
+
+    ++iter;
+    iter = insert_before(iter, std::forward<U>(value));
+    --iter;
+    --iter;
+    return iter;
+}
+
+template <typename T, size_t N, class Alloc>
+template <typename U>
+void XorUnrolledList<T, N, Alloc>::push_back(U&& value) {
+    insert_before(end(), std::forward<U>(value));
+}
+
+template <typename T, size_t N, class Alloc>
+template <typename U>
+void XorUnrolledList<T, N, Alloc>::push_front(U&& value) {
+    insert_before(begin(), std::forward<U>(value));
+}
+
+//---------------------------------------------------------------------------------
+
+template <typename T, size_t N, class Alloc>
+typename XorUnrolledList<T, N, Alloc>::iterator XorUnrolledList<T, N, Alloc>::erase
+        (iterator iter) {
+#ifdef DEBUG
+    if (iter._node == nullptr)
+        throw YException("XorUnrolledList: trying to erase element after last");
+    if (iter._version != this->_version)
+        throw YException("XorUnrolledList: Iterator is invalid because the list has been changed");
+    if (iter._list != this)
+        throw YException("XorUnrolledList: trying to use iterator from other list");
+#endif
+
+    node* prev = iter._prev_node;
+    node* cur = iter._node;
+    size_t pos = iter._index;
+    node* next = xor_ptr(prev, cur->ptr);
+
+    cur->value(pos).~T();
+    for (size_t i = pos + 1; i < cur->count; ++i) {
+        move_value(cur, i, cur, i - 1);
+    }
+    cur->count--;
+
+    _size--;
+#if DEBUG
+    _version++;
+#endif
+
+    if (cur->count == 0) {
+        unlink_node(prev, cur, next);
+        free_node(cur);
+        return make_iterator(prev, next, 0);
+    }
+
+    if (cur->count < N / 2 and next != nullptr and cur->count + next->count <= N) {
+        node* after_next = xor_ptr(cur, next->ptr);
+        for (size_t i = 0; i < next->count; ++i) {
+            move_value(next, i, cur, cur->count + i);
+        }
+        cur->count += next->count;
+        next->count = 0;
+        unlink_node(cur, next, after_next);
+        free_node(next);
+    }
+
+    return make_iterator(prev, cur, pos);
+}
+
+template <typename T, size_t N, class Alloc>
+void XorUnrolledList<T, N, Alloc>::pop_back() {
+    auto it = end();
+    --it;
+    erase(it);
+}
+
+template <typename T, size_t N, class Alloc>
+void XorUnrolledList<T, N, Alloc>::pop_front() {
+    erase(begin());
+}
+
+//---------------------------------------------------------------------------------
+
+template <typename T, size_t N, class Alloc>
+T& XorUnrolledList<T, N, Alloc>::back() {
+    if (_size == 0)
+        throw YException("XorUnrolledList: trying to get elements from empty list");
+
+    return _last->value(_last->count - 1);
+}
+
+template <typename T, size_t N, class Alloc>
+T& XorUnrolledList<T, N, Alloc>::front() {
+    if (_size == 0)
+        throw YException("XorUnrolledList: trying to get elements from empty list");
+
+    return _first->value(0);
+}
+
+//**********************************************************************************
+
+template <typename T, size_t N, class Alloc>
+XorUnrolledListIterator<T, N, Alloc>& XorUnrolledListIterator<T, N, Alloc>::operator++() {
+#if DEBUG
+    if (!is_valid())
+        throw YException("XorUnrolledList iterator: Iterator is invalid because the list has been changed");
+#endif
+
+    if (_index + 1 < _node->count) {
+        ++_index;
+        return *this;
+    }
+
+    auto next_node = xor_ptr(_prev_node, _node->ptr);
+    _prev_node = _node;
+    _node = next_node;
+    _index = 0;
+    return *this;
+}
+
+template <typename T, size_t N, class Alloc>
+XorUnrolledListIterator<T, N, Alloc>& XorUnrolledListIterator<T, N, Alloc>::operator--() {
+#if DEBUG
+    if (!is_valid())
+        throw YException("XorUnrolledList iterator: Iterator is invalid because the list has been changed");
+#endif
+
+    if (_node != nullptr and _index > 0) {
+        --_index;
+        return *this;
+    }
+
+    auto very_prev_node = xor_ptr(_prev_node->ptr, _node);
+    _node = _prev_node;
+    _prev_node = very_prev_node;
+    _index = _node->count - 1;
+    return *this;
+}
+
+template <typename T, size_t N, class Alloc>
+const XorUnrolledListIterator<T, N, Alloc> XorUnrolledListIterator<T, N, Alloc>::operator++(int) {
+    auto result = *this;
+    operator++();
+    return result;
+}
+
+template <typename T, size_t N, class Alloc>
+const XorUnrolledListIterator<T, N, Alloc> XorUnrolledListIterator<T, N, Alloc>::operator--(int) {
+    auto result = *this;
+    operator--();
+    return result;
+}
+
+//----------------------------------------------------------------------------------
+
+template <typename T, size_t N, class Alloc>
+bool XorUnrolledListIterator<T, N, Alloc>::operator==
+        (const XorUnrolledListIterator<T, N, Alloc>& other) const {
+
+    return _list == other._list and _node == other._node and _index == other._index;
+}
+
+template <typename T, size_t N, class Alloc>
+bool XorUnrolledListIterator<T, N, Alloc>::operator!=
+        (const XorUnrolledListIterator<T, N, Alloc>& other) const {
+    return not (*this == other);
+}
+
+template <typename T, size_t N, class Alloc>
+T& XorUnrolledListIterator<T, N, Alloc>::operator*() {
+    return _node->value(_index);
+}
+
+template <typename T, size_t N, class Alloc>
+T* XorUnrolledListIterator<T, N, Alloc>::operator->() {
+    return &(_node->value(_index));
+}
+
+#if DEBUG
+template <typename T, size_t N, class Alloc>
+bool XorUnrolledListIterator<T, N, Alloc>::is_valid() const {
+    return _version == _list->_version;
+}
+#endif
@@ -0,0 +1,109 @@
+#include <cerrno>
+#include <cstring>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "workload.h"
+
+namespace {
+
+    const char* const PROFILE_NAMES[COUNT_OF_WORKLOAD_PROFILES] = {
+        "fifo", "lifo", "sliding", "mid_edit", "build_scan"
+    };
+
+    YException system_error(const std::string& what) {
+        return YException("run_isolated: " + what + ": " + strerror(errno));
+    }
+
+}
+
+//------------------------------------------------------------------------------------
+
+WorkloadConfig::WorkloadConfig():
+    profile(FIFO_QUEUE),
+    operations(100000000),
+    list_size(100000),
+    mix(0.5),
+    seed(1)
+{}
+
+WorkloadResult::WorkloadResult():
+    operations(0),
+    seconds(0),
+    peak_rss_kb(0),
+    checksum(0)
+{}
+
+double WorkloadResult::ops_per_second() const {
+    return seconds > 0 ? operations / seconds : 0;
+}
+
+const char* profile_name(WorkloadProfile profile) {
+    if (profile < 0 or profile >= COUNT_OF_WORKLOAD_PROFILES) {
+        return "unknown";
+    }
+    return PROFILE_NAMES[profile];
+}
+
+bool parse_profile(const std::string& name, WorkloadProfile& profile) {
+    for (int i = 0; i < COUNT_OF_WORKLOAD_PROFILES; ++i) {
+        if (name == PROFILE_NAMES[i]) {
+            profile = static_cast<WorkloadProfile>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// ru_maxrss is in kilobytes on Linux.
+size_t peak_rss_kb() {
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+    return (size_t)usage.ru_maxrss;
+}
+
+//------------------------------------------------------------------------------------
+
+// The child starts with the resident set of the parent at fork, which is
+// small next to a list of millions of nodes.
+WorkloadResult run_isolated(const std::function<WorkloadResult()>& run) {
+    int fds[2];
+    if (pipe(fds) != 0) {
+        throw system_error("can't create pipe");
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        throw system_error("can't fork");
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        int status = 1;
+        try {
+            WorkloadResult result = run();
+            result.peak_rss_kb = peak_rss_kb();
+            if (write(fds[1], &result, sizeof(result)) == (ssize_t)sizeof(result)) {
+                status = 0;
+            }
+        }
+        catch (...) {}
+        _exit(status);
+    }
+
+    close(fds[1]);
+    WorkloadResult result;
+    ssize_t got = read(fds[0], &result, sizeof(result));
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 and errno == EINTR) {}
+    if (got != (ssize_t)sizeof(result) or not WIFEXITED(status) or WEXITSTATUS(status) != 0) {
+        throw YException("run_isolated: workload failed in child process");
+    }
+    return result;
+}
@@ -0,0 +1,239 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <functional>
+#include <string>
+#include "smallfunctions.h"
+
+enum WorkloadProfile {FIFO_QUEUE = 0, LIFO_STACK, SLIDING_WINDOW, MID_EDIT,
+    BUILD_SCAN, COUNT_OF_WORKLOAD_PROFILES};
+
+// mix is the share of operations of the profile's main kind:
+//   FIFO_QUEUE, LIFO_STACK - pushes, the rest pop (push_back/pop_front for
+//       the queue, push_back/pop_back for the stack);
+//   SLIDING_WINDOW - pushes to the back that evict the front once the window
+//       holds list_size elements, the rest read both ends;
+//   MID_EDIT - edits at an iterator cursor, half inserts and half erases,
+//       the rest move the cursor forward;
+//   BUILD_SCAN - pushes while building a list of list_size elements, the
+//       rest visit elements in full scans of it, after which it is cleared.
+// All profiles but BUILD_SCAN start with list_size elements.
+struct WorkloadConfig {
+    WorkloadProfile profile;
+    size_t operations;
+    size_t list_size;
+    double mix;
+    uint64_t seed;
+
+    WorkloadConfig();
+};
+
+struct WorkloadResult {
+    size_t operations;
+    double seconds;
+    // Zero unless the run went through run_isolated().
+    size_t peak_rss_kb;
+    // Sum of all values read, equal for every container given the same config.
+    long long checksum;
+
+    WorkloadResult();
+    double ops_per_second() const;
+};
+
+const char* profile_name(WorkloadProfile);
+// Takes the names profile_name() gives; returns false for others.
+bool parse_profile(const std::string& name, WorkloadProfile& profile);
+
+// Peak resident set of this process so far.
+size_t peak_rss_kb();
+
+// Runs the workload in a forked child, so that peak_rss_kb of the result
+// covers this run alone and nothing it leaves behind reaches the caller.
+WorkloadResult run_isolated(const std::function<WorkloadResult()>& run);
+
+template <class List>
+WorkloadResult run_workload(const WorkloadConfig& config);
+
+//=======================================================================================
+//=======================================================================================
+
+namespace workload_detail {
+
+    // xorshift64*, cheap enough not to show up next to list operations.
+    class Random {
+    public:
+        explicit Random(uint64_t seed): _state(seed != 0 ? seed : 1) {}
+
+        uint64_t next() {
+            _state ^= _state >> 12;
+            _state ^= _state << 25;
+            _state ^= _state >> 27;
+            return _state * 2685821657736338717ULL;
+        }
+
+        int value() {
+            return (int)(next() >> 40);
+        }
+
+    private:
+        uint64_t _state;
+    };
+
+    // Draws true with probability mix, compared on the top 32 bits.
+    class Choice {
+    public:
+        explicit Choice(double mix):
+                _threshold(mix <= 0 ? 0 : mix >= 1 ? (1ULL << 32) : (uint64_t)(mix * 4294967296.0)) {}
+
+        bool operator()(Random& random) const {
+            return (random.next() >> 32) < _threshold;
+        }
+
+    private:
+        uint64_t _threshold;
+    };
+
+    template <class List>
+    void fill(List& list, size_t size, Random& random) {
+        for (size_t i = 0; i < size; ++i) {
+            list.push_back(random.value());
+        }
+    }
+
+    template <class List>
+    long long fifo_queue(List& list, const WorkloadConfig& config, Random& random) {
+        Choice push(config.mix);
+        long long checksum = 0;
+        for (size_t i = 0; i < config.operations; ++i) {
+            if (push(random) or list.empty()) {
+                list.push_back(random.value());
+            }
+            else {
+                checksum += list.front();
+                list.pop_front();
+            }
+        }
+        return checksum;
+    }
+
+    template <class List>
+    long long lifo_stack(List& list, const WorkloadConfig& config, Random& random) {
+        Choice push(config.mix);
+        long long checksum = 0;
+        for (size_t i = 0; i < config.operations; ++i) {
+            if (push(random) or list.empty()) {
+                list.push_back(random.value());
+            }
+            else {
+                checksum += list.back();
+                list.pop_back();
+            }
+        }
+        return checksum;
+    }
+
+    template <class List>
+    long long sliding_window(List& list, const WorkloadConfig& config, Random& random) {
+        Choice push(config.mix);
+        long long checksum = 0;
+        for (size_t i = 0; i < config.operations; ++i) {
+            if (push(random) or list.empty()) {
+                list.push_back(random.value());
+                if (list.size() > config.list_size) {
+                    checksum += list.front();
+                    list.pop_front();
+                }
+            }
+            else {
+                checksum += list.front() - list.back();
+            }
+        }
+        return checksum;
+    }
+
+    // emplace() gives the new element and erase() the next one for every
+    // container measured, so one cursor loop serves them all.
+    template <class List>
+    long long mid_edit(List& list, const WorkloadConfig& config, Random& random) {
+        Choice edit(config.mix);
+        long long checksum = 0;
+        auto cursor = list.begin();
+        for (size_t i = 0; i < config.operations; ++i) {
+            if (cursor == list.end()) {
+                cursor = list.begin();
+            }
+            if (not edit(random)) {
+                if (cursor != list.end()) {
+                    checksum += *cursor;
+                    ++cursor;
+                }
+            }
+            else if ((random.next() & 1) or list.empty()) {
+                cursor = list.emplace(cursor, random.value());
+            }
+            else {
+                cursor = list.erase(cursor);
+            }
+        }
+        return checksum;
+    }
+
+    template <class List>
+    long long build_scan(List& list, const WorkloadConfig& config, Random& random) {
+        Choice build(config.mix);
+        long long checksum = 0;
+        size_t done = 0;
+        while (done < config.operations) {
+            for (size_t i = 0; i < config.list_size and done < config.operations; ++i, ++done) {
+                list.push_back(random.value());
+            }
+            // Scans until their share of the operations matches 1 - mix.
+            while (done < config.operations and not build(random)) {
+                for (auto it = list.begin(); it != list.end() and done < config.operations; ++it, ++done) {
+                    checksum += *it;
+                }
+            }
+            list.clear();
+        }
+        return checksum;
+    }
+
+}
+
+template <class List>
+WorkloadResult run_workload(const WorkloadConfig& config) {
+    using namespace workload_detail;
+    Random random(config.seed);
+    List list;
+    if (config.profile != BUILD_SCAN) {
+        fill(list, config.list_size, random);
+    }
+
+    WorkloadResult result;
+    result.operations = config.operations;
+    auto start = std::chrono::steady_clock::now();
+    switch (config.profile) {
+        case FIFO_QUEUE:
+            result.checksum = fifo_queue(list, config, random);
+            break;
+        case LIFO_STACK:
+            result.checksum = lifo_stack(list, config, random);
+            break;
+        case SLIDING_WINDOW:
+            result.checksum = sliding_window(list, config, random);
+            break;
+        case MID_EDIT:
+            result.checksum = mid_edit(list, config, random);
+            break;
+        case BUILD_SCAN:
+            result.checksum = build_scan(list, config, random);
+            break;
+        default:
+            throw YException("run_workload: unknown workload profile");
+    }
+    auto finish = std::chrono::steady_clock::now();
+
+    result.seconds = std::chrono::duration<double>(finish - start).count();
+    return result;
+}
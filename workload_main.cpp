@@ -0,0 +1,134 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <string>
+#include <vector>
+#include "allocator.h"
+#include "concurrent_allocator.h"
+#include "list.h"
+#include "workload.h"
+
+// Usage: XorList_workload [--profile=NAME|all] [--ops=N] [--size=N] [--mix=R] [--seed=N]
+// Every profile runs once per container, each run in its own process.
+
+namespace {
+
+    struct Container {
+        const char* name;
+        WorkloadResult (*run)(const WorkloadConfig&);
+        // std::deque edits the middle in O(n), which would take hours.
+        bool mid_edit;
+    };
+
+    const Container CONTAINERS[] = {
+        {"XorList<std::allocator>", run_workload<XorList<int> >, true},
+        {"XorList<StackAllocator>", run_workload<XorList<int, StackAllocator<int> > >, true},
+        {"XorList<ConcurrentStackAllocator>", run_workload<XorList<int, ConcurrentStackAllocator<int> > >, true},
+        {"std::list", run_workload<std::list<int> >, true},
+        {"std::deque", run_workload<std::deque<int> >, false},
+    };
+
+    bool read_option(const char* arg, const char* name, std::string& value) {
+        size_t length = strlen(name);
+        if (strncmp(arg, name, length) != 0 or arg[length] != '=') {
+            return false;
+        }
+        value = arg + length + 1;
+        return true;
+    }
+
+    void usage(const char* program) {
+        fprintf(stderr, "usage: %s [--profile=NAME|all] [--ops=N] [--size=N] [--mix=R] [--seed=N]\n", program);
+        fprintf(stderr, "profiles:");
+        for (int i = 0; i < COUNT_OF_WORKLOAD_PROFILES; ++i) {
+            fprintf(stderr, " %s", profile_name(static_cast<WorkloadProfile>(i)));
+        }
+        fprintf(stderr, "\n");
+    }
+
+}
+
+int main(int argc, char** argv) {
+    WorkloadConfig config;
+    std::vector<WorkloadProfile> profiles;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string value;
+        if (read_option(argv[i], "--profile", value)) {
+            WorkloadProfile profile;
+            if (value == "all") {
+                profiles.clear();
+            }
+            else if (parse_profile(value, profile)) {
+                profiles.push_back(profile);
+            }
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (read_option(argv[i], "--ops", value)) {
+            config.operations = (size_t)strtod(value.c_str(), nullptr);
+        }
+        else if (read_option(argv[i], "--size", value)) {
+            config.list_size = (size_t)strtod(value.c_str(), nullptr);
+        }
+        else if (read_option(argv[i], "--mix", value)) {
+            config.mix = strtod(value.c_str(), nullptr);
+        }
+        else if (read_option(argv[i], "--seed", value)) {
+            config.seed = strtoull(value.c_str(), nullptr, 10);
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (profiles.empty()) {
+        for (int i = 0; i < COUNT_OF_WORKLOAD_PROFILES; ++i) {
+            profiles.push_back(static_cast<WorkloadProfile>(i));
+        }
+    }
+
+    printf("operations %zu, list size %zu, mix %.2f, seed %llu\n\n",
+           config.operations, config.list_size, config.mix, (unsigned long long)config.seed);
+    printf("%-12s %-36s %14s %14s %20s\n", "profile", "container", "Mops/s", "peak RSS MiB", "checksum");
+
+    bool checksums_agree = true;
+    for (auto profile : profiles) {
+        config.profile = profile;
+        long long expected = 0;
+        for (size_t i = 0; i < sizeof(CONTAINERS) / sizeof(CONTAINERS[0]); ++i) {
+            const Container& container = CONTAINERS[i];
+            if (profile == MID_EDIT and not container.mid_edit) {
+                printf("%-12s %-36s %14s\n", profile_name(profile), container.name, "skipped");
+                continue;
+            }
+            WorkloadResult result;
+            try {
+                result = run_isolated([&container, &config]() {
+                    return container.run(config);
+                });
+            }
+            catch (const YException& error) {
+                printf("%-12s %-36s %s\n", profile_name(profile), container.name, error.what());
+                checksums_agree = false;
+                continue;
+            }
+
+            if (i == 0) {
+                expected = result.checksum;
+            }
+            bool agrees = result.checksum == expected;
+            checksums_agree = checksums_agree and agrees;
+            printf("%-12s %-36s %14.2f %14.1f %20lld%s\n", profile_name(profile), container.name,
+                   result.ops_per_second() / 1e6, result.peak_rss_kb / 1024.0,
+                   result.checksum, agrees ? "" : " MISMATCH");
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+    return checksums_agree ? 0 : 1;
+}